@@ -31,7 +31,7 @@ void error::print_cmdline()
 {
 	int i = 0;
 	for (i = 0; i < m_orig_argc; ++i)
-		printf(" %s", m_orig_argv[i]);
+		cout << " " << m_orig_argv[i];
 }
 
 #include <boost/format.hpp>
@@ -0,0 +1,616 @@
+/* kabi-bin.cpp - binary graph format for kabi-parser and kabi-lookup utilities
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+
+#include "kabi-bin.h"
+#include "kabi-store.h"
+
+using namespace std;
+
+/***********************************
+**  kbbuf
+***********************************/
+
+bool kbbuf::open(const string& filename)
+{
+	struct stat st;
+	int fd;
+
+	close();
+
+	// A compressed file can't be used in place, so decompress it into
+	// the heap.
+	if (kb_is_zstd(filename)) {
+		boost::iostreams::filtering_istream in;
+
+		if (!kb_open_istream(filename, in))
+			return false;
+
+		try {
+			boost::iostreams::copy(in, back_inserter(m_heap));
+		} catch (exception& e) {
+			m_heap.clear();
+			return false;
+		}
+
+		if (m_heap.empty())
+			return false;
+
+		m_data = m_heap.data();
+		m_size = m_heap.size();
+		return true;
+	}
+
+	if ((fd = ::open(filename.c_str(), O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &st) || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	m_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (m_map == MAP_FAILED) {
+		m_map = NULL;
+		return false;
+	}
+
+	m_data = (const char *)m_map;
+	m_size = st.st_size;
+	return true;
+}
+
+void kbbuf::close()
+{
+	if (m_map)
+		munmap(m_map, m_size);
+
+	m_map = NULL;
+	m_data = NULL;
+	m_size = 0;
+	m_heap.clear();
+}
+
+/***********************************
+**  kbsecfile
+***********************************/
+
+bool kbsecfile::open(const string& filename)
+{
+	const kbhdr *hdr;
+
+	close();
+
+	// Don't decompress a whole file just to find it's a text archive.
+	if (kb_is_zstd(filename) && !kb_is_binmap(filename))
+		return false;
+
+	if (!m_buf.open(filename))
+		return false;
+
+	hdr = (const kbhdr *)m_buf.data();
+
+	if ((m_buf.size() < sizeof(kbhdr)) ||
+	    memcmp(hdr->magic, KB_BIN_MAGIC, sizeof(hdr->magic)) ||
+	    (hdr->version > KB_BIN_VERSION) ||
+	    (hdr->sectab > m_buf.size()) ||
+	    (hdr->nsections > (m_buf.size() - hdr->sectab) / sizeof(kbsec))) {
+		close();
+		return false;
+	}
+
+	m_version = hdr->version;
+	m_nsections = hdr->nsections;
+	m_sectab = (const kbsec *)(m_buf.data() + hdr->sectab);
+	return true;
+}
+
+void kbsecfile::close()
+{
+	m_buf.close();
+	m_version = 0;
+	m_sectab = NULL;
+	m_nsections = 0;
+}
+
+const char *kbsecfile::section(kbsecid id, size_t *size) const
+{
+	for (uint32_t i = 0; i < m_nsections; ++i) {
+		const kbsec& sec = m_sectab[i];
+
+		if (sec.id != id)
+			continue;
+
+		if ((sec.offset > m_buf.size()) ||
+		    (sec.size > m_buf.size() - sec.offset))
+			break;
+
+		*size = sec.size;
+		return m_buf.data() + sec.offset;
+	}
+
+	*size = 0;
+	return NULL;
+}
+
+/***********************************
+**  kbsecwriter
+***********************************/
+
+bool kbsecwriter::open(const string& filename, bool compress)
+{
+	kbhdr hdr;
+
+	m_filename = filename;
+	m_compress = compress;
+
+	// The header can only be finished after the sections are written, so
+	// a compressed file is built in memory and compressed on close.
+	if (compress)
+		m_fp = open_memstream(&m_membuf, &m_memsize);
+	else
+		m_fp = fopen(filename.c_str(), "w");
+
+	if (!m_fp)
+		return false;
+
+	// The header is rewritten with the section table offset on close.
+	memset(&hdr, 0, sizeof(hdr));
+	fwrite(&hdr, sizeof(hdr), 1, m_fp);
+	m_offset = sizeof(hdr);
+	m_sections.clear();
+	return true;
+}
+
+void kbsecwriter::pad()
+{
+	static const char zeroes[KB_BIN_ALIGN] = {0};
+	size_t padsize = (KB_BIN_ALIGN - (m_offset % KB_BIN_ALIGN)) % KB_BIN_ALIGN;
+
+	fwrite(zeroes, 1, padsize, m_fp);
+	m_offset += padsize;
+}
+
+void kbsecwriter::add(kbsecid id, const void *data, size_t size)
+{
+	kbsec sec;
+
+	pad();
+	memset(&sec, 0, sizeof(sec));
+	sec.id = id;
+	sec.offset = m_offset;
+	sec.size = size;
+	m_sections.push_back(sec);
+
+	if (size)
+		fwrite(data, 1, size, m_fp);
+
+	m_offset += size;
+}
+
+bool kbsecwriter::close()
+{
+	kbhdr hdr;
+	bool ok;
+
+	pad();
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, KB_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = KB_BIN_VERSION;
+	hdr.nsections = m_sections.size();
+	hdr.sectab = m_offset;
+
+	fwrite(m_sections.data(), sizeof(kbsec), m_sections.size(), m_fp);
+
+	// A memory stream ends at the last write position when it is closed,
+	// so the header of a compressed file is patched in the buffer instead.
+	if (!m_compress) {
+		rewind(m_fp);
+		fwrite(&hdr, sizeof(hdr), 1, m_fp);
+	}
+
+	ok = !ferror(m_fp);
+	ok = (fclose(m_fp) == 0) && ok;
+	m_fp = NULL;
+
+	if (m_compress) {
+		if (ok) {
+			memcpy(m_membuf, &hdr, sizeof(hdr));
+
+			boost::iostreams::filtering_ostream out;
+
+			try {
+				out.push(boost::iostreams::zstd_compressor());
+				out.push(boost::iostreams::file_sink(m_filename,
+					 ios_base::out | ios_base::binary));
+				out.write(m_membuf, m_memsize);
+				out.reset();
+			} catch (exception& e) {
+				ok = false;
+			}
+		}
+
+		free(m_membuf);
+		m_membuf = NULL;
+		m_memsize = 0;
+	}
+
+	return ok;
+}
+
+/***********************************
+**  kbstrpool
+***********************************/
+
+uint32_t kbstrpool::add(const string& str)
+{
+	if (str.empty())
+		return 0;
+
+	auto it = m_index.find(str);
+	if (it != m_index.end())
+		return it->second;
+
+	uint32_t offset = m_pool.size();
+	m_pool.insert(m_pool.end(), str.begin(), str.end());
+	m_pool.push_back('\0');
+	m_index.insert(make_pair(str, offset));
+	return offset;
+}
+
+/***********************************
+**  kbgraph
+***********************************/
+
+bool kbgraph::open(const string& filename)
+{
+	size_t count;
+
+	m_strids.clear();
+	m_typecount = 0;
+
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_dnodes = m_file.table<kbdnrec>(KBS_DNODES, &m_dncount);
+	m_cnodes = m_file.table<kbcnrec>(KBS_CNODES, &m_cncount);
+	m_kids = m_file.table<kbcrcrec>(KBS_CHILDREN, &m_kidcount);
+	m_cnfiles = m_file.table<uint64_t>(KBS_CNFILES, &count);
+
+	if (count != m_cncount)
+		m_cnfiles = NULL;
+
+	m_typerefs = m_file.table<kbtyperec>(KBS_TYPEREFS, &m_typecount);
+	m_typestore = m_file.section(KBS_TYPESTORE, &count);
+
+	if (m_typecount && (!m_typestore || !count || m_typestore[count - 1])) {
+		m_file.close();
+		return false;
+	}
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1]) {
+		m_file.close();
+		return false;
+	}
+
+	// Check the record cross references once here, so that the lookups
+	// don't have to.
+	for (size_t i = 0; i < m_dncount; ++i) {
+		const kbdnrec& dr = m_dnodes[i];
+
+		if ((dr.decl >= m_strsize) ||
+		    (dr.sibidx > m_cncount) ||
+		    (dr.sibcount > m_cncount - dr.sibidx) ||
+		    (dr.kididx > m_kidcount) ||
+		    (dr.kidcount > m_kidcount - dr.kididx)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_cncount; ++i) {
+		if (m_cnodes[i].name >= m_strsize) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const kbdnrec *kbgraph::find(crc_t crc) const
+{
+	const kbdnrec *end = m_dnodes + m_dncount;
+	const kbdnrec *dr;
+
+	dr = lower_bound(m_dnodes, end, crc,
+		[](const kbdnrec& lhs, crc_t rhs) {
+			return lhs.crc < rhs;
+		});
+
+	return (dr != end && dr->crc == crc) ? dr : NULL;
+}
+
+const char *kbgraph::str(uint32_t offset) const
+{
+	return &m_strings[offset];
+}
+
+/******************************************************************************
+ * kbgraph::strid(uint32_t offset)
+ *
+ * Returns the strtab id of the string at offset in KBS_STRINGS. Each string
+ * in the pool is interned only once, however many records refer to it.
+ */
+strid_t kbgraph::strid(uint32_t offset) const
+{
+	auto it = m_strids.find(offset);
+
+	if (it != m_strids.end())
+		return it->second;
+
+	strid_t id = kb_intern(str(offset));
+	m_strids.insert(make_pair(offset, id));
+	return id;
+}
+
+const kbcnrec *kbgraph::siblings(const kbdnrec& dr) const
+{
+	return &m_cnodes[dr.sibidx];
+}
+
+const kbcrcrec *kbgraph::children(const kbdnrec& dr) const
+{
+	return &m_kids[dr.kididx];
+}
+
+void kbgraph::get_cnode(const kbcnrec& cr, cnode& cn) const
+{
+	cn.function = cr.function;
+	cn.argument = cr.argument;
+	cn.level = cr.level;
+	cn.order = cr.order;
+	cn.flags = (ctlflags)cr.flags;
+	cn.name = strid(cr.name);
+	cn.parent = make_pair(cr.parent_order, (crc_t)cr.parent_crc);
+	cn.sibling = make_pair(cr.sibling_order, (crc_t)cr.sibling_crc);
+	cn.file = m_cnfiles ? m_cnfiles[&cr - m_cnodes] : 0;
+}
+
+void kbgraph::get_dnode(const kbdnrec& dr, dnode& dn) const
+{
+	const kbcnrec *cr = siblings(dr);
+	const kbcrcrec *kr = children(dr);
+
+	dn.decl = strid(dr.decl);
+
+	for (uint32_t i = 0; i < dr.sibcount; ++i) {
+		cnode cn;
+		get_cnode(cr[i], cn);
+		dn.siblings.insert(dn.siblings.end(), make_pair(cr[i].order, cn));
+	}
+
+	for (uint32_t i = 0; i < dr.kidcount; ++i)
+		dn.children.insert(dn.children.end(),
+				   make_pair(kr[i].order, (crc_t)kr[i].crc));
+}
+
+void kbgraph::decode(dnodemap& dnmap) const
+{
+	dnmap.clear();
+
+	for (size_t i = 0; i < m_dncount; ++i) {
+		dniterator dnit;
+		dnit = dnmap.insert(dnmap.end(), make_pair(m_dnodes[i].crc, dnode()));
+		get_dnode(m_dnodes[i], dnit->second);
+	}
+
+	for (size_t i = 0; i < m_typecount; ++i) {
+		dniterator dnit = dnmap.find(m_typerefs[i].crc);
+
+		if (dnit != dnmap.end())
+			dnit->second.typedigest = m_typerefs[i].digest;
+	}
+}
+
+/***********************************
+**  Global functions
+***********************************/
+
+bool kb_is_zstd(const string& filename)
+{
+	uint32_t magic;
+	ifstream ifs(filename.c_str(), ifstream::binary);
+
+	if (!ifs.read((char *)&magic, sizeof(magic)))
+		return false;
+
+	return magic == KB_ZSTD_MAGIC;
+}
+
+/******************************************************************************
+ * kb_open_istream(string& filename, filtering_istream& in)
+ *
+ * Open the file for reading through the stream, with a zstd decompressor in
+ * front of it if the file is compressed. Nothing is decompressed ahead of
+ * the reader.
+ */
+bool kb_open_istream(const string& filename,
+		     boost::iostreams::filtering_istream& in)
+{
+	bool compressed = kb_is_zstd(filename);
+	boost::iostreams::file_source src(filename,
+					  ios_base::in | ios_base::binary);
+
+	if (!src.is_open())
+		return false;
+
+	if (compressed)
+		in.push(boost::iostreams::zstd_decompressor());
+
+	in.push(src);
+	return true;
+}
+
+bool kb_is_binmap(const string& filename)
+{
+	char magic[sizeof(((kbhdr *)0)->magic)];
+	boost::iostreams::filtering_istream in;
+
+	if (!kb_open_istream(filename, in))
+		return false;
+
+	try {
+		if (!in.read(magic, sizeof(magic)))
+			return false;
+	} catch (exception& e) {
+		return false;
+	}
+
+	return memcmp(magic, KB_BIN_MAGIC, sizeof(magic)) == 0;
+}
+
+int kb_read_binmap(const string& filename, dnodemap& dnmap)
+{
+	kbgraph kbg;
+
+	if (!kbg.open(filename)) {
+		cout << "Cannot read binary graph: " << filename << endl;
+		return -1;
+	}
+
+	kbg.decode(dnmap);
+
+	if (kbg.has_typerefs())
+		return kb_resolve_types(dnmap, kbg.typestore());
+
+	return 0;
+}
+
+/******************************************************************************
+ * kb_write_binmap(string& filename, dnodemap& dnmap)
+ *
+ * The dnodemap is already sorted by crc, and each cnodemap and crcnodemap
+ * is already sorted by order, so the records can be written in map order
+ * and read back with binary searches.
+ */
+int kb_write_binmap(const string& filename, dnodemap& dnmap, bool compress)
+{
+	kbsecwriter kbw;
+	kbstrpool strings;
+	vector<kbdnrec> dnodes;
+	vector<kbcnrec> cnodes;
+	vector<kbcrcrec> kids;
+	vector<uint64_t> cnfiles;
+	vector<kbtyperec> typerefs;
+	string storedir = kb_get_typestore(dnmap);
+
+	dnodes.reserve(dnmap.size());
+
+	for (auto& it : dnmap) {
+		dnode& dn = it.second;
+		kbdnrec dr;
+
+		memset(&dr, 0, sizeof(dr));
+		dr.crc = it.first;
+		dr.decl = strings.add(kb_str(dn.decl));
+		dr.sibidx = cnodes.size();
+		dr.sibcount = dn.siblings.size();
+		dr.kididx = kids.size();
+		dr.kidcount = dn.children.size();
+		dnodes.push_back(dr);
+
+		if (dn.typedigest) {
+			kbtyperec tr;
+
+			tr.crc = it.first;
+			tr.digest = dn.typedigest;
+			typerefs.push_back(tr);
+		}
+
+		for (auto& cnit : dn.siblings) {
+			cnode& cn = cnit.second;
+			kbcnrec cr;
+
+			memset(&cr, 0, sizeof(cr));
+			cr.function = cn.function;
+			cr.argument = cn.argument;
+			cr.parent_crc = cn.parent.second;
+			cr.sibling_crc = cn.sibling.second;
+			cr.parent_order = cn.parent.first;
+			cr.sibling_order = cn.sibling.first;
+			cr.level = cn.level;
+			cr.order = cnit.first;
+			cr.flags = cn.flags;
+			cr.name = strings.add(kb_str(cn.name));
+			cnodes.push_back(cr);
+			cnfiles.push_back(cn.file);
+		}
+
+		for (auto& crcit : dn.children) {
+			kbcrcrec kr;
+
+			memset(&kr, 0, sizeof(kr));
+			kr.order = crcit.first;
+			kr.crc = crcit.second;
+			kids.push_back(kr);
+		}
+	}
+
+	if (!kbw.open(filename, compress)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_STRINGS, strings.pool().data(), strings.pool().size());
+	kbw.add(KBS_DNODES, dnodes.data(), dnodes.size() * sizeof(kbdnrec));
+	kbw.add(KBS_CNODES, cnodes.data(), cnodes.size() * sizeof(kbcnrec));
+	kbw.add(KBS_CHILDREN, kids.data(), kids.size() * sizeof(kbcrcrec));
+	kbw.add(KBS_CNFILES, cnfiles.data(), cnfiles.size() * sizeof(uint64_t));
+
+	if (!typerefs.empty()) {
+		kbw.add(KBS_TYPEREFS, typerefs.data(),
+			typerefs.size() * sizeof(kbtyperec));
+		kbw.add(KBS_TYPESTORE, storedir.c_str(), storedir.size() + 1);
+	}
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
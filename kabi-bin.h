@@ -0,0 +1,316 @@
+/* kabi-bin.h - binary graph format for kabi-parser and kabi-lookup utilities
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef KABIBIN_H
+#define KABIBIN_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include "kabi-map.h"
+
+/*
+ * The binary graph is an alternative to the boost text archive. It is
+ * written in native byte order and is meant to be mmapped and searched
+ * in place by kabi-lookup, without building a dnodemap first.
+ *
+ *   +----------------------+
+ *   | kbhdr                |  magic, version, location of section table
+ *   +----------------------+
+ *   | section data         |  each section starts on an 8 byte boundary
+ *   |   ...                |
+ *   +----------------------+
+ *   | kbsec[nsections]     |  section table (footer)
+ *   +----------------------+
+ *
+ * Graph sections
+ *
+ *   KBS_STRINGS  - string pool. NUL terminated strings, each stored once.
+ *                  Records refer to strings by their offset in the pool.
+ *   KBS_DNODES   - kbdnrec array, sorted by crc, so a dnode can be found
+ *                  with a binary search.
+ *   KBS_CNODES   - kbcnrec array. The siblings of each dnode are a
+ *                  contiguous run, in order.
+ *   KBS_CHILDREN - kbcrcrec array. The children of each dnode are a
+ *                  contiguous run, in order.
+ *   KBS_CNFILES  - uint64_t array parallel to KBS_CNODES, with the crc of
+ *                  the file each cnode came from. Optional, older graphs
+ *                  do not have it.
+ *   KBS_TYPEREFS - kbtyperec array, sorted by crc, for the dnodes whose
+ *                  type expansion is in the type store, see kabi-store.h.
+ *                  Only present if there are any.
+ *   KBS_TYPESTORE- NUL terminated path to the type store. Only present
+ *                  with KBS_TYPEREFS.
+ *
+ * Either format can be compressed with zstd, conventionally named .kbg.zst.
+ * Compressed files are recognized by the zstd frame magic and decompressed
+ * as they are read. A compressed binary graph is decompressed into the heap
+ * instead of being mmapped.
+ */
+
+#define KB_BIN_MAGIC	"KBGRAPH"	// 8 bytes with the terminating NUL
+#define KB_BIN_VERSION	1
+#define KB_BIN_ALIGN	8
+#define KB_ZSTD_MAGIC	0xFD2FB528	// first 4 bytes of a zstd frame, LE
+
+enum kbsecid {
+	KBS_NONE,
+	KBS_STRINGS,
+	KBS_DNODES,
+	KBS_CNODES,
+	KBS_CHILDREN,
+	KBS_CNFILES,
+	KBS_IDXFILES,
+	KBS_IDXCRCS,
+	KBS_IDXPOSTINGS,
+	KBS_TYPEREFS,
+	KBS_TYPESTORE,
+	KBS_BLMFILES,
+	KBS_BLMBITS,
+	KBS_RCHEXPORTS,
+	KBS_RCHCRCS,
+	KBS_RCHCONTS,
+	KBS_RCHWORDS,
+	KBS_SUBINFO,
+	KBS_SUBCRCS,
+	KBS_SUBGRAMS,
+	KBS_SUBPOSTINGS,
+	KBS_WHTSOURCES,
+	KBS_WHTDISPS,
+	KBS_WHTSLOTS,
+	KBS_CATEXPORTS,
+	KBS_COUNT
+};
+
+struct kbhdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t nsections;
+	uint64_t sectab;	// file offset of the section table
+};
+
+struct kbsec {
+	uint32_t id;		// enum kbsecid
+	uint32_t reserved;
+	uint64_t offset;	// file offset of the section data
+	uint64_t size;		// size of the section data in bytes
+};
+
+struct kbdnrec {
+	uint64_t crc;
+	uint32_t decl;		// offset in KBS_STRINGS
+	uint32_t sibidx;	// index of first sibling in KBS_CNODES
+	uint32_t sibcount;
+	uint32_t kididx;	// index of first child in KBS_CHILDREN
+	uint32_t kidcount;
+	uint32_t reserved;
+};
+
+struct kbcnrec {
+	uint64_t function;
+	uint64_t argument;
+	uint64_t parent_crc;
+	uint64_t sibling_crc;
+	int32_t parent_order;
+	int32_t sibling_order;
+	int32_t level;
+	int32_t order;
+	uint32_t flags;
+	uint32_t name;		// offset in KBS_STRINGS
+};
+
+struct kbcrcrec {
+	int32_t order;
+	uint32_t reserved;
+	uint64_t crc;
+};
+
+struct kbtyperec {
+	uint64_t crc;
+	uint64_t digest;	// dnode::typedigest
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbbuf holds the contents of a binary file, either mmapped read-only or
+// copied into the heap.
+//
+class kbbuf
+{
+public:
+	kbbuf(){}
+	~kbbuf() { close(); }
+
+	bool open(const std::string& filename);
+	void close();
+	const char *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	kbbuf(const kbbuf&);
+	void operator =(const kbbuf&);
+
+	const char *m_data = NULL;
+	size_t m_size = 0;
+	void *m_map = NULL;
+	std::vector<char> m_heap;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbsecfile is the reader side of the sectioned file layout. Anything that
+// uses the layout can find its sections through it.
+//
+class kbsecfile
+{
+public:
+	kbsecfile(){}
+
+	bool open(const std::string& filename);
+	void close();
+	bool is_open() const { return m_buf.data() != NULL; }
+	uint32_t version() const { return m_version; }
+	const char *section(kbsecid id, size_t *size) const;
+
+	template <typename T>
+	const T *table(kbsecid id, size_t *count) const
+	{
+		size_t size;
+		const T *t = (const T *)section(id, &size);
+		*count = t ? size / sizeof(T) : 0;
+		return t;
+	}
+
+private:
+	kbbuf m_buf;
+	uint32_t m_version = 0;
+	const kbsec *m_sectab = NULL;
+	uint32_t m_nsections = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbsecwriter is the writer side of the sectioned file layout.
+//
+class kbsecwriter
+{
+public:
+	kbsecwriter(){}
+
+	bool open(const std::string& filename, bool compress = false);
+	void add(kbsecid id, const void *data, size_t size);
+	bool close();
+
+private:
+	void pad();
+
+	FILE *m_fp = NULL;
+	std::string m_filename;
+	bool m_compress = false;
+	char *m_membuf = NULL;	// the file is built here when compressing
+	size_t m_memsize = 0;
+	uint64_t m_offset = 0;
+	std::vector<kbsec> m_sections;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbstrpool collects the strings for KBS_STRINGS. Every distinct string is
+// stored only once.
+//
+class kbstrpool
+{
+public:
+	kbstrpool() { m_pool.push_back('\0'); } // offset 0 is ""
+
+	uint32_t add(const std::string& str);
+	const std::vector<char>& pool() const { return m_pool; }
+
+private:
+	std::map<std::string, uint32_t> m_index;
+	std::vector<char> m_pool;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbgraph is a read-only view of a binary graph. The dnode records can be
+// searched in place, and individual dnodes can be materialized into the
+// usual dnode class when the caller needs them, see kb_set_lazy_graph().
+//
+class kbgraph
+{
+public:
+	kbgraph(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); m_strids.clear(); m_typecount = 0; }
+	bool is_open() const { return m_file.is_open(); }
+
+	// A graph with type references is not complete until they are
+	// resolved, so it cannot be searched in place.
+	bool has_typerefs() const { return m_typecount != 0; }
+	std::string typestore() const { return m_typestore ? m_typestore : ""; }
+
+	size_t size() const { return m_dncount; }
+	const kbdnrec& dnrec(size_t index) const { return m_dnodes[index]; }
+	const kbdnrec *find(crc_t crc) const;
+	const char *str(uint32_t offset) const;
+	strid_t strid(uint32_t offset) const;
+	const kbcnrec *siblings(const kbdnrec& dr) const;
+	const kbcrcrec *children(const kbdnrec& dr) const;
+
+	void get_cnode(const kbcnrec& cr, cnode& cn) const;
+	void get_dnode(const kbdnrec& dr, dnode& dn) const;
+	void decode(dnodemap& dnmap) const;
+
+private:
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const kbdnrec *m_dnodes = NULL;
+	size_t m_dncount = 0;
+	const kbcnrec *m_cnodes = NULL;
+	size_t m_cncount = 0;
+	const kbcrcrec *m_kids = NULL;
+	size_t m_kidcount = 0;
+	const uint64_t *m_cnfiles = NULL;
+	const kbtyperec *m_typerefs = NULL;
+	size_t m_typecount = 0;
+	const char *m_typestore = NULL;
+	mutable std::unordered_map<uint32_t, strid_t> m_strids;
+};
+
+/*****************************************
+** Function Prototypes
+*****************************************/
+
+extern bool kb_is_zstd(const std::string& filename);
+extern bool kb_open_istream(const std::string& filename,
+			    boost::iostreams::filtering_istream& in);
+extern bool kb_is_binmap(const std::string& filename);
+extern int kb_read_binmap(const std::string& filename, dnodemap& dnmap);
+extern int kb_write_binmap(const std::string& filename, dnodemap& dnmap,
+			   bool compress = false);
+extern void kb_set_lazy_graph(const kbgraph *kbg);
+
+#endif // KABIBIN_H
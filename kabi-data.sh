@@ -13,7 +13,7 @@ attr_OFF="\033[0m"
 usagestr=$(
 cat <<EOF
 
-$ $(basename $0) -d directory [-s subdir -f filelist -e errfile -V -h]
+$ $(basename $0) -d directory [-s subdir -f filelist -e errfile -j jobs -b -z -t -V -h]
 
   - Given a path to the top of the kernel tree, this script calls the
     kabi-parser tool to create a kbg graph file from each .i file in
@@ -32,6 +32,15 @@ $ $(basename $0) -d directory [-s subdir -f filelist -e errfile -V -h]
                  rebuilt.
   -e errfile   - Optional error file. By default, errors are sent
                  to /dev/null
+  -j jobs      - Optional. Number of kabi-parser processes. The default
+                 is the number of processors.
+  -b           - Optional. Write the graphs in the binary format, which
+                 kabi-lookup can search without deserializing them.
+  -z           - Optional. Compress the graphs with zstd. They are named
+                 .kbg.zst instead of .kbg
+  -t           - Optional. Keep the data types shared by the graphs once,
+                 in the type store at redhat/kabi/types, instead of in
+                 every graph that uses them.
   -V           - Version of this file.
   -h           - This help message
 
@@ -44,6 +53,10 @@ directory=""
 subdir=""
 datafile="kabi-data.dat"
 errfile="/dev/null"
+parseropts="-x"
+suffix="kbg"
+typestore=""
+jobs=$(nproc)
 
 usage() {
 	echo -e "$usagestr"
@@ -71,7 +84,7 @@ noexistdir() {
 	usage
 }
 
-while getopts "Vhd:s:f:e:" OPTION; do
+while getopts "Vhbztd:s:f:e:j:" OPTION; do
     case "$OPTION" in
 
 	d )	directory="$OPTARG"
@@ -84,6 +97,15 @@ while getopts "Vhd:s:f:e:" OPTION; do
 		;;
 	e )	errfile="$OPTARG"
 		;;
+	j )	jobs="$OPTARG"
+		;;
+	b )	parseropts="$parseropts"b
+		;;
+	z )	parseropts="$parseropts"z
+		suffix="kbg.zst"
+		;;
+	t )	typestore="types"
+		;;
 	V )	echo "Version : $toolkitversion$fileversion"
 		exit
 		;;
@@ -106,17 +128,29 @@ echo "kabi file list: $filelist"
 rm -vf $filelist
 
 [ -d "$outdir" ] || mkdir -p $outdir
+[ "$typestore" ] && parseropts="$parseropts -t $outdir/$typestore"
 
 START=$(date +%s)
 
-find $directory/$subdir -name \*.i -exec sh -c \
-        'datafile="${1%.*}.kbg"; \
-	kabi-parser -xo "$datafile" -f $1 -S -Wall_off 2>$2; \
-	if [ -f "$datafile" ]; then \
-                echo "$datafile" >> $3; \
-                echo ${1%.*}; \
-        fi;' \
-	sh '{}' $errfile $filelist \;
+# One kabi-parser parses all the .i files, with a few worker processes,
+# and prints the name of each graph as it is written.
+#
+ilist=$(mktemp)
+glist=$(mktemp)
+find $directory/$subdir -name \*.i > $ilist
+kabi-parser $parseropts -j $jobs -l $ilist -S -Wall_off 2>$errfile | \
+	tee $glist | sed "s/\.$suffix\$//"
+
+# List the graphs in the order of the .i files, rather than the order in
+# which they were finished, so the list is the same from run to run.
+#
+sed "s/\.[^./]*\$/.$suffix/" $ilist | grep -Fxf $glist > $filelist
+rm -f $ilist $glist
+
+# Index the graphs, so whole word lookups only read the files that have
+# the symbol.
+#
+which kabi-index > /dev/null 2>&1 && kabi-index -q -f $filelist
 
 END=$(date +%s)
 DIFF=$(( $END - $START ))
@@ -0,0 +1,1505 @@
+/* kabi-index.cpp - index of the graph files for kabi-lookup
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "kabi-index.h"
+
+using namespace std;
+
+/***********************************
+**  Static functions
+***********************************/
+
+// The crcs are not spread evenly enough to index the filter with directly,
+// so they are mixed first, with the splitmix64 finalizer. The two halves
+// of the result make the probe sequence of the crc.
+static inline uint64_t bloom_hash(crc_t crc)
+{
+	uint64_t h = crc + 0x9E3779B97F4A7C15ULL;
+
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
+
+static inline uint64_t bloom_bit(uint64_t hash, uint32_t probe, uint64_t nbits)
+{
+	uint64_t h1 = hash & 0xFFFFFFFF;
+	uint64_t h2 = (hash >> 32) | 1;
+
+	return (h1 + probe * h2) % nbits;
+}
+
+static inline int64_t get_mtime(const struct stat& st)
+{
+	return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static inline uint32_t get_gram(kbsubkind kind, const char *str)
+{
+	return ((uint32_t)kind << 24) | ((uint32_t)(uint8_t)str[0] << 16) |
+	       ((uint32_t)(uint8_t)str[1] << 8) | (uint32_t)(uint8_t)str[2];
+}
+
+static void put_varint(vector<uint8_t>& buf, uint32_t val)
+{
+	while (val >= 0x80) {
+		buf.push_back((val & 0x7F) | 0x80);
+		val >>= 7;
+	}
+
+	buf.push_back(val);
+}
+
+static void add_grams(unordered_map<uint32_t, vector<uint32_t> >& grams,
+		      kbsubkind kind, const string& str, uint32_t num)
+{
+	for (size_t i = 0; i + 3 <= str.size(); ++i) {
+		vector<uint32_t>& nums = grams[get_gram(kind, &str[i])];
+
+		// A gram can occur more than once in the string.
+		if (nums.empty() || (nums.back() != num))
+			nums.push_back(num);
+	}
+}
+
+// FNV-1a of a white listed symbol, started from the seed and mixed like the
+// crcs of the Bloom filters. Seed 0 gives the bucket of the symbol, and the
+// displacement of the bucket gives its slot.
+static inline uint64_t white_hash(const char *str, uint32_t seed)
+{
+	uint64_t h = 0xCBF29CE484222325ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+
+	for (; *str; ++str) {
+		h ^= (uint8_t)*str;
+		h *= 0x100000001B3ULL;
+	}
+
+	return bloom_hash(h);
+}
+
+// The signature of an exported function is the crc of the declarations of
+// its children, the return and the arguments, each with its name.
+static uint32_t get_signature(const kbgraph& kbg, const kbdnrec& dr)
+{
+	const kbcrcrec *kids = kbg.children(dr);
+	string sig;
+
+	for (uint32_t i = 0; i < dr.kidcount; ++i) {
+		const kbdnrec *kr = kbg.find(kids[i].crc);
+
+		if (!kr)
+			continue;
+
+		const kbcnrec *cr = kbg.siblings(*kr);
+
+		sig += kbg.str(kr->decl);
+		sig += ' ';
+
+		for (uint32_t j = 0; j < kr->sibcount; ++j) {
+			if (cr[j].order == kids[i].order) {
+				sig += kbg.str(cr[j].name);
+				break;
+			}
+		}
+
+		sig += ';';
+	}
+
+	return raw_crc32(sig.c_str());
+}
+
+static uint32_t get_signature(dnodemap& dnmap, dnode& dn)
+{
+	string sig;
+
+	for (auto& it : dn.children) {
+		auto kit = dnmap.find(it.second);
+
+		if (kit == dnmap.end())
+			continue;
+
+		dnode& kid = kit->second;
+		auto cit = kid.siblings.find(it.first);
+
+		sig += kb_str(kid.decl);
+		sig += ' ';
+
+		if (cit != kid.siblings.end())
+			sig += kb_str(cit->second.name);
+
+		sig += ';';
+	}
+
+	return raw_crc32(sig.c_str());
+}
+
+static string get_sidecar_name(const string& filelist, const char *ext)
+{
+	size_t slash = filelist.find_last_of('/');
+	size_t dot = filelist.find_last_of('.');
+
+	if ((dot == string::npos) || ((slash != string::npos) && (dot < slash)))
+		return filelist + ext;
+
+	return filelist.substr(0, dot) + ext;
+}
+
+/***********************************
+**  kbindex
+***********************************/
+
+bool kbindex::open(const string& filename)
+{
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_files = m_file.table<uint32_t>(KBS_IDXFILES, &m_filecount);
+	m_crcs = m_file.table<kbidxrec>(KBS_IDXCRCS, &m_crccount);
+	m_postings = m_file.table<uint32_t>(KBS_IDXPOSTINGS, &m_postcount);
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1] ||
+	    !m_files || !m_crcs || !m_postings) {
+		m_file.close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_filecount; ++i) {
+		if (m_files[i] >= m_strsize) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_crccount; ++i) {
+		const kbidxrec& ir = m_crcs[i];
+
+		if ((ir.first > m_postcount) ||
+		    (ir.count > m_postcount - ir.first)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const char *kbindex::file(size_t index) const
+{
+	return &m_strings[m_files[index]];
+}
+
+/******************************************************************************
+ * kbindex::find(crc_t crc, vector<uint32_t>& files)
+ *
+ * Fill the files vector with the numbers of the graph files containing the
+ * crc, in the order of the file list. Returns false if no file has it.
+ */
+bool kbindex::find(crc_t crc, vector<uint32_t>& files) const
+{
+	const kbidxrec *end = m_crcs + m_crccount;
+	const kbidxrec *ir;
+
+	files.clear();
+
+	ir = lower_bound(m_crcs, end, crc,
+		[](const kbidxrec& lhs, crc_t rhs) {
+			return lhs.crc < rhs;
+		});
+
+	if (ir == end || ir->crc != crc)
+		return false;
+
+	files.assign(&m_postings[ir->first], &m_postings[ir->first + ir->count]);
+	return true;
+}
+
+/***********************************
+**  kbbloom
+***********************************/
+
+bool kbbloom::open(const string& filename)
+{
+	m_names.clear();
+
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_recs = m_file.table<kbblmrec>(KBS_BLMFILES, &m_reccount);
+	m_bits = m_file.table<uint64_t>(KBS_BLMBITS, &m_bitcount);
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1] ||
+	    !m_recs || !m_bits) {
+		m_file.close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_reccount; ++i) {
+		const kbblmrec& br = m_recs[i];
+
+		if ((br.name >= m_strsize) || !br.nwords ||
+		    (br.first > m_bitcount) ||
+		    (br.nwords > m_bitcount - br.first)) {
+			close();
+			return false;
+		}
+
+		m_names[&m_strings[br.name]] = i;
+	}
+
+	return true;
+}
+
+/******************************************************************************
+ * kbbloom::may_have(string& datafile, crc_t crc)
+ *
+ * Returns false only if the graph file certainly has no dnode with the crc.
+ * A file without a filter, or that changed since its filter was made, may
+ * have anything.
+ */
+bool kbbloom::may_have(const string& datafile, crc_t crc) const
+{
+	auto it = m_names.find(datafile);
+	struct stat st;
+
+	if (it == m_names.end())
+		return true;
+
+	const kbblmrec& br = m_recs[it->second];
+
+	if (stat(datafile.c_str(), &st) ||
+	    ((uint64_t)st.st_size != br.size) || (get_mtime(st) != br.mtime))
+		return true;
+
+	const uint64_t *words = &m_bits[br.first];
+	uint64_t hash = bloom_hash(crc);
+
+	for (uint32_t probe = 0; probe < br.nhashes; ++probe) {
+		uint64_t bit = bloom_bit(hash, probe, br.nwords * 64);
+
+		if (!(words[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+/***********************************
+**  kbreach
+***********************************/
+
+bool kbreach::open(const string& filename)
+{
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_files = m_file.table<uint32_t>(KBS_IDXFILES, &m_filecount);
+	m_exports = m_file.table<kbrchexp>(KBS_RCHEXPORTS, &m_expcount);
+	m_crcs = m_file.table<kbrchrec>(KBS_RCHCRCS, &m_crccount);
+	m_conts = m_file.table<kbbmcont>(KBS_RCHCONTS, &m_contcount);
+	m_words = m_file.table<uint16_t>(KBS_RCHWORDS, &m_wordcount);
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1] ||
+	    !m_files || !m_crcs) {
+		m_file.close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_filecount; ++i) {
+		if (m_files[i] >= m_strsize) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_expcount; ++i) {
+		if (m_exports[i].name >= m_strsize) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_crccount; ++i) {
+		const kbbmref& er = m_crcs[i].exports;
+		const kbbmref& fr = m_crcs[i].files;
+
+		if ((er.first > m_contcount) ||
+		    (er.count > m_contcount - er.first) ||
+		    (fr.first > m_contcount) ||
+		    (fr.count > m_contcount - fr.first)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_contcount; ++i) {
+		const kbbmcont& bc = m_conts[i];
+		uint64_t nwords = bc.isbitmap ? KB_BM_WORDS : bc.card;
+
+		if ((bc.offset > m_wordcount) ||
+		    (nwords > m_wordcount - bc.offset)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const char *kbreach::file(size_t index) const
+{
+	return &m_strings[m_files[index]];
+}
+
+const char *kbreach::export_name(uint32_t id) const
+{
+	return id < m_expcount ? &m_strings[m_exports[id].name] : "";
+}
+
+/******************************************************************************
+ * kbreach::find(crc_t crc, vector<uint32_t>& exports, vector<uint32_t>& files)
+ *
+ * Fill the exports vector with the numbers of the exported functions that
+ * reach the crc, and the files vector with the numbers of the graph files
+ * where they do, both in ascending order. Returns false if no file has the
+ * crc.
+ */
+bool kbreach::find(crc_t crc, vector<uint32_t>& exports,
+		   vector<uint32_t>& files) const
+{
+	const kbrchrec *end = m_crcs + m_crccount;
+	const kbrchrec *rr;
+
+	exports.clear();
+	files.clear();
+
+	rr = lower_bound(m_crcs, end, crc,
+		[](const kbrchrec& lhs, crc_t rhs) {
+			return lhs.crc < rhs;
+		});
+
+	if (rr == end || rr->crc != crc)
+		return false;
+
+	get_bitmap(rr->exports, exports);
+	get_bitmap(rr->files, files);
+	return true;
+}
+
+void kbreach::get_bitmap(const kbbmref& ref, vector<uint32_t>& nums) const
+{
+	for (uint32_t c = ref.first; c < ref.first + ref.count; ++c) {
+		const kbbmcont& bc = m_conts[c];
+		const uint16_t *words = &m_words[bc.offset];
+		uint32_t high = (uint32_t)bc.key << 16;
+
+		if (!bc.isbitmap) {
+			for (uint32_t i = 0; i < bc.card; ++i)
+				nums.push_back(high | words[i]);
+			continue;
+		}
+
+		for (uint32_t w = 0; w < KB_BM_WORDS; ++w)
+			for (uint32_t bits = words[w]; bits; bits &= bits - 1)
+				nums.push_back(high | (w * 16 +
+						       __builtin_ctz(bits)));
+	}
+}
+
+/***********************************
+**  kbcatalog
+***********************************/
+
+bool kbcatalog::open(const string& filename)
+{
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_files = m_file.table<uint32_t>(KBS_IDXFILES, &m_filecount);
+	m_recs = m_file.table<kbcatrec>(KBS_CATEXPORTS, &m_reccount);
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1] ||
+	    !m_files || !m_recs) {
+		m_file.close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_filecount; ++i) {
+		if (m_files[i] >= m_strsize) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_reccount; ++i) {
+		const kbcatrec& cr = m_recs[i];
+
+		if ((cr.name >= m_strsize) || (cr.source >= m_strsize) ||
+		    (cr.module >= m_strsize) || (cr.file >= m_filecount)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const char *kbcatalog::file(size_t index) const
+{
+	return &m_strings[m_files[index]];
+}
+
+/******************************************************************************
+ * kbcatalog::find_prefix(string& prefix, size_t *first, size_t *last)
+ *
+ * Set first and last to the range of the records whose names start with
+ * the prefix. The range is empty if there are none.
+ */
+void kbcatalog::find_prefix(const string& prefix,
+			    size_t *first, size_t *last) const
+{
+	const kbcatrec *end = m_recs + m_reccount;
+	const kbcatrec *lo;
+	const kbcatrec *hi;
+	const char *strings = m_strings;
+	size_t len = prefix.size();
+
+	lo = lower_bound(m_recs, end, prefix,
+		[strings, len](const kbcatrec& lhs, const string& rhs) {
+			return strncmp(&strings[lhs.name], rhs.c_str(), len) < 0;
+		});
+
+	hi = upper_bound(lo, end, prefix,
+		[strings, len](const string& lhs, const kbcatrec& rhs) {
+			return strncmp(lhs.c_str(), &strings[rhs.name], len) < 0;
+		});
+
+	*first = lo - m_recs;
+	*last = hi - m_recs;
+}
+
+/***********************************
+**  kbsubindex
+***********************************/
+
+bool kbsubindex::open(const string& filename)
+{
+	size_t infosize;
+
+	if (!m_file.open(filename))
+		return false;
+
+	m_info = (const kbsubinfo *)m_file.section(KBS_SUBINFO, &infosize);
+	m_crcs = m_file.table<uint64_t>(KBS_SUBCRCS, &m_crccount);
+	m_grams = m_file.table<kbgramrec>(KBS_SUBGRAMS, &m_gramcount);
+	m_postings = m_file.table<uint8_t>(KBS_SUBPOSTINGS, &m_postsize);
+
+	if (!m_info || (infosize != sizeof(kbsubinfo)) || !m_grams) {
+		m_file.close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_gramcount; ++i) {
+		const kbgramrec& gr = m_grams[i];
+
+		if ((gr.offset > m_postsize) ||
+		    (gr.size > m_postsize - gr.offset) ||
+		    (gr.count > m_crccount)) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/******************************************************************************
+ * kbsubindex::is_current(string& graph)
+ *
+ * Returns true if the graph file has not changed since the index was made.
+ */
+bool kbsubindex::is_current(const string& graph) const
+{
+	struct stat st;
+
+	return !stat(graph.c_str(), &st) &&
+	       ((uint64_t)st.st_size == m_info->size) &&
+	       (get_mtime(st) == m_info->mtime);
+}
+
+/******************************************************************************
+ * kbsubindex::find(string& str, kbsubkind kind, vector<crc_t>& crcs)
+ *
+ * Fill the crcs vector with the crcs of the dnodes that have every trigram
+ * of str, in ascending order. They are only candidates, each must still be
+ * checked for the whole of str. Returns false if str is too short to have
+ * a trigram, so every dnode is a candidate.
+ */
+bool kbsubindex::find(const string& str, kbsubkind kind,
+		      vector<crc_t>& crcs) const
+{
+	vector<const kbgramrec *> recs;
+	vector<uint32_t> nums;
+	vector<uint32_t> next;
+	vector<uint32_t> both;
+
+	crcs.clear();
+
+	if (str.size() < 3)
+		return false;
+
+	for (size_t i = 0; i + 3 <= str.size(); ++i) {
+		uint32_t gram = get_gram(kind, &str[i]);
+		const kbgramrec *end = m_grams + m_gramcount;
+		const kbgramrec *gr;
+
+		gr = lower_bound(m_grams, end, gram,
+			[](const kbgramrec& lhs, uint32_t rhs) {
+				return lhs.gram < rhs;
+			});
+
+		if (gr == end || gr->gram != gram)
+			return true;
+
+		recs.push_back(gr);
+	}
+
+	// Start with the rarest gram, so the candidates only get fewer.
+	sort(recs.begin(), recs.end(),
+		[](const kbgramrec *lhs, const kbgramrec *rhs) {
+			return lhs->count < rhs->count;
+		});
+	recs.erase(unique(recs.begin(), recs.end()), recs.end());
+
+	get_postings(*recs[0], nums);
+
+	for (size_t i = 1; i < recs.size() && !nums.empty(); ++i) {
+		get_postings(*recs[i], next);
+		both.clear();
+		set_intersection(nums.begin(), nums.end(),
+				 next.begin(), next.end(),
+				 back_inserter(both));
+		nums.swap(both);
+	}
+
+	for (uint32_t num : nums)
+		if (num < m_crccount)
+			crcs.push_back(m_crcs[num]);
+
+	return true;
+}
+
+void kbsubindex::get_postings(const kbgramrec& gr, vector<uint32_t>& nums) const
+{
+	const uint8_t *p = &m_postings[gr.offset];
+	const uint8_t *end = p + gr.size;
+	uint32_t num = 0;
+
+	nums.clear();
+	nums.reserve(gr.count);
+
+	while (p < end) {
+		uint32_t delta = 0;
+		int shift = 0;
+
+		while ((p < end) && (*p & 0x80) && (shift < 28)) {
+			delta |= (uint32_t)(*p++ & 0x7F) << shift;
+			shift += 7;
+		}
+
+		if (p == end)
+			break;
+
+		delta |= (uint32_t)*p++ << shift;
+		num += delta;
+		nums.push_back(num);
+	}
+}
+
+/***********************************
+**  kbwhitelist
+***********************************/
+
+bool kbwhitelist::open(const string& filename)
+{
+	close();
+
+	if (!m_file.open(filename))
+		return false;
+
+	m_strings = m_file.section(KBS_STRINGS, &m_strsize);
+	m_sources = m_file.table<kbwhtsrc>(KBS_WHTSOURCES, &m_srccount);
+	m_disps = m_file.table<int32_t>(KBS_WHTDISPS, &m_dispcount);
+	m_slots = m_file.table<uint32_t>(KBS_WHTSLOTS, &m_slotcount);
+
+	if (!m_strings || !m_strsize || m_strings[m_strsize - 1] ||
+	    !m_sources || !m_disps || !m_dispcount || !m_slots)
+		goto badfile;
+
+	for (size_t i = 0; i < m_srccount; ++i)
+		if (m_sources[i].name >= m_strsize)
+			goto badfile;
+
+	for (size_t i = 0; i < m_slotcount; ++i)
+		if (m_slots[i] >= m_strsize)
+			goto badfile;
+
+	for (size_t i = 0; i < m_dispcount; ++i)
+		if ((m_disps[i] < 0) && ((size_t)-(m_disps[i] + 1) >= m_slotcount))
+			goto badfile;
+
+	return true;
+
+badfile:
+	close();
+	return false;
+}
+
+void kbwhitelist::close()
+{
+	m_file.close();
+	m_strings = NULL;
+	m_sources = NULL;
+	m_disps = NULL;
+	m_slots = NULL;
+	m_strsize = m_srccount = m_dispcount = m_slotcount = 0;
+	m_pool = kbstrpool();
+	m_heapdisps.clear();
+	m_heapslots.clear();
+}
+
+/******************************************************************************
+ * kbwhitelist::is_current(vector<string>& sources)
+ *
+ * Returns true if the cache was made from these white lists, and none of
+ * them has changed since. The sources must be sorted.
+ */
+bool kbwhitelist::is_current(const vector<string>& sources) const
+{
+	if (sources.size() != m_srccount)
+		return false;
+
+	for (size_t i = 0; i < m_srccount; ++i) {
+		const kbwhtsrc& src = m_sources[i];
+		struct stat st;
+
+		if ((sources[i] != &m_strings[src.name]) ||
+		    stat(sources[i].c_str(), &st) ||
+		    ((uint64_t)st.st_size != src.size) ||
+		    (get_mtime(st) != src.mtime))
+			return false;
+	}
+
+	return true;
+}
+
+/******************************************************************************
+ * kbwhitelist::build(vector<string>& symbols)
+ *
+ * Build the hash table of the symbols in the heap. The buckets with the
+ * most symbols are placed first, while there are still plenty of free slots
+ * for them. The buckets with one symbol are then given the slots that are
+ * left.
+ */
+void kbwhitelist::build(const vector<string>& symbols)
+{
+	vector<string> syms(symbols);
+	vector<vector<uint32_t> > buckets;
+	vector<uint32_t> order;
+	vector<bool> used;
+	vector<uint32_t> slots;
+	size_t nslots;
+	size_t free = 0;
+
+	close();
+	sort(syms.begin(), syms.end());
+	syms.erase(unique(syms.begin(), syms.end()), syms.end());
+
+	nslots = syms.size();
+	buckets.resize(nslots / 2 + 1);
+	m_heapdisps.assign(buckets.size(), 0);
+	m_heapslots.assign(nslots, 0);
+	used.assign(nslots, false);
+
+	for (uint32_t i = 0; i < nslots; ++i)
+		buckets[white_hash(syms[i].c_str(), 0) % buckets.size()]
+			.push_back(i);
+
+	for (uint32_t i = 0; i < buckets.size(); ++i)
+		order.push_back(i);
+
+	stable_sort(order.begin(), order.end(),
+		[&buckets](uint32_t lhs, uint32_t rhs) {
+			return buckets[lhs].size() > buckets[rhs].size();
+		});
+
+	for (uint32_t b : order) {
+		vector<uint32_t>& bucket = buckets[b];
+
+		if (bucket.size() == 0)
+			break;
+
+		if (bucket.size() == 1) {
+			while (used[free])
+				++free;
+
+			used[free] = true;
+			m_heapslots[free] = m_pool.add(syms[bucket[0]]);
+			m_heapdisps[b] = -(int32_t)free - 1;
+			continue;
+		}
+
+		for (int32_t seed = 1; ; ++seed) {
+			size_t i;
+
+			slots.clear();
+
+			for (i = 0; i < bucket.size(); ++i) {
+				const char *sym = syms[bucket[i]].c_str();
+				uint32_t slot = white_hash(sym, seed) % nslots;
+
+				if (used[slot] || (find(slots.begin(), slots.end(),
+							slot) != slots.end()))
+					break;
+
+				slots.push_back(slot);
+			}
+
+			if (i < bucket.size())
+				continue;
+
+			for (i = 0; i < bucket.size(); ++i) {
+				used[slots[i]] = true;
+				m_heapslots[slots[i]] = m_pool.add(syms[bucket[i]]);
+			}
+
+			m_heapdisps[b] = seed;
+			break;
+		}
+	}
+
+	m_strings = m_pool.pool().data();
+	m_strsize = m_pool.pool().size();
+	m_disps = m_heapdisps.data();
+	m_dispcount = m_heapdisps.size();
+	m_slots = m_heapslots.data();
+	m_slotcount = m_heapslots.size();
+}
+
+/******************************************************************************
+ * kbwhitelist::write(string& filename, vector<string>& sources)
+ *
+ * Write the table made by build() to the cache, with the white lists it
+ * was made from. The cache is written to a temporary file first, so that
+ * no other kabi-lookup ever reads half of it.
+ */
+int kbwhitelist::write(const string& filename,
+		       const vector<string>& sources) const
+{
+	string tmpname = filename + ".tmp" + to_string(getpid());
+	kbstrpool pool(m_pool);
+	vector<kbwhtsrc> srcs;
+	kbsecwriter kbw;
+
+	for (auto& source : sources) {
+		struct stat st;
+		kbwhtsrc src;
+
+		if (stat(source.c_str(), &st))
+			return -1;
+
+		memset(&src, 0, sizeof(src));
+		src.name = pool.add(source);
+		src.size = st.st_size;
+		src.mtime = get_mtime(st);
+		srcs.push_back(src);
+	}
+
+	if (!kbw.open(tmpname))
+		return -1;
+
+	kbw.add(KBS_STRINGS, pool.pool().data(), pool.pool().size());
+	kbw.add(KBS_WHTSOURCES, srcs.data(), srcs.size() * sizeof(kbwhtsrc));
+	kbw.add(KBS_WHTDISPS, m_disps, m_dispcount * sizeof(int32_t));
+	kbw.add(KBS_WHTSLOTS, m_slots, m_slotcount * sizeof(uint32_t));
+
+	if (!kbw.close() || rename(tmpname.c_str(), filename.c_str())) {
+		remove(tmpname.c_str());
+		return -1;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * kbwhitelist::has(const char *symbol)
+ */
+bool kbwhitelist::has(const char *symbol) const
+{
+	int32_t disp;
+	size_t slot;
+
+	if (!m_slotcount)
+		return false;
+
+	disp = m_disps[white_hash(symbol, 0) % m_dispcount];
+
+	if (!disp)
+		return false;
+
+	slot = (disp < 0) ? -(disp + 1) : white_hash(symbol, disp) % m_slotcount;
+	return !strcmp(&m_strings[m_slots[slot]], symbol);
+}
+
+/***********************************
+**  kbindexer
+***********************************/
+
+/******************************************************************************
+ * kbindexer::add_file(string& datafile)
+ *
+ * Record the crc of every dnode in the graph file, in the index and in a
+ * Bloom filter of the file. The exported functions at the top of each
+ * instance of the dnode go in the reachability index. Binary graphs are
+ * read in place, unless part of them is in the type store. The file is
+ * numbered in the index even if it cannot be read, so that the numbers
+ * still follow the file list.
+ */
+int kbindexer::add_file(const string& datafile)
+{
+	uint32_t filenum = m_files.size();
+	vector<uint32_t> exports;
+	kbgraph kbg;
+	struct stat st;
+	bool filter;
+
+	m_files.push_back(datafile);
+	m_crcs.clear();
+
+	// The file is measured before it is read, so a filter never claims
+	// to be of a newer file than the one it was made from.
+	filter = (stat(datafile.c_str(), &st) == 0);
+
+	if (kbg.open(datafile) && !kbg.has_typerefs()) {
+		for (size_t i = 0; i < kbg.size(); ++i) {
+			const kbdnrec& dr = kbg.dnrec(i);
+			const kbcnrec *cr = kbg.siblings(dr);
+
+			m_crcs.push_back(dr.crc);
+			exports.clear();
+
+			if (dr.sibcount && (cr->level == LVL_EXPORTED)) {
+				const kbdnrec *sr = kbg.find(cr->parent_crc);
+
+				add_catalog(dr.crc, kbg.str(cr->name),
+					    sr ? kbg.str(sr->decl) : "",
+					    get_signature(kbg, dr), filenum, i);
+			}
+
+			for (uint32_t j = 0; j < dr.sibcount; ++j) {
+				const kbdnrec *fr = cr[j].function ?
+					kbg.find(cr[j].function) : NULL;
+
+				if (!fr || !fr->sibcount)
+					continue;
+
+				exports.push_back(get_export(cr[j].function,
+					kbg.str(kbg.siblings(*fr)->name)));
+			}
+
+			if (dr.sibcount)
+				add_reach(dr.crc, filenum, exports);
+		}
+	} else {
+		kbg.close();
+
+		if (kb_read_dnodemap(datafile, m_dnmap) != 0)
+			return -1;
+
+		for (auto& it : m_dnmap) {
+			dnode& dn = it.second;
+
+			m_crcs.push_back(it.first);
+			exports.clear();
+
+			if (!dn.siblings.empty() &&
+			    (dn.siblings.begin()->second.level == LVL_EXPORTED)) {
+				cnode& cn = dn.siblings.begin()->second;
+				auto sit = m_dnmap.find(cn.parent.second);
+
+				add_catalog(it.first, kb_str(cn.name),
+					    (sit != m_dnmap.end()) ?
+						kb_str(sit->second.decl) : "",
+					    get_signature(m_dnmap, dn), filenum,
+					    KB_CAT_NODNODE);
+			}
+
+			for (auto& sit : dn.siblings) {
+				crc_t func = sit.second.function;
+				auto fit = func ? m_dnmap.find(func) : m_dnmap.end();
+
+				if ((fit == m_dnmap.end()) ||
+				    fit->second.siblings.empty())
+					continue;
+
+				cnode& fcn = fit->second.siblings.begin()->second;
+				exports.push_back(get_export(func,
+					kb_str(fcn.name).c_str()));
+			}
+
+			if (!dn.siblings.empty())
+				add_reach(it.first, filenum, exports);
+		}
+	}
+
+	for (crc_t crc : m_crcs)
+		m_postings[crc].push_back(filenum);
+
+	if (filter)
+		add_bloom(datafile, st, m_crcs);
+
+	return 0;
+}
+
+void kbindexer::add_bloom(const string& datafile, const struct stat& st,
+			  const vector<crc_t>& crcs)
+{
+	kbblmrec br;
+	uint64_t nbits;
+
+	memset(&br, 0, sizeof(br));
+	br.nhashes = KB_BLOOM_HASHES;
+	br.first = m_blmbits.size();
+	br.nwords = (crcs.size() * KB_BLOOM_BITS + 63) / 64;
+	br.nwords = max(br.nwords, (uint64_t)1);
+	br.size = st.st_size;
+	br.mtime = get_mtime(st);
+	nbits = br.nwords * 64;
+
+	m_blmbits.resize(m_blmbits.size() + br.nwords);
+	uint64_t *words = &m_blmbits[br.first];
+
+	for (crc_t crc : crcs) {
+		uint64_t hash = bloom_hash(crc);
+
+		for (uint32_t probe = 0; probe < br.nhashes; ++probe) {
+			uint64_t bit = bloom_bit(hash, probe, nbits);
+			words[bit / 64] |= 1ULL << (bit % 64);
+		}
+	}
+
+	m_blmrecs.push_back(make_pair(datafile, br));
+}
+
+/******************************************************************************
+ * kbindexer::add_reach(crc_t crc, uint32_t filenum, vector<uint32_t>& exports)
+ *
+ * Record that the exported functions in exports reach the crc in the graph
+ * file numbered filenum. The exports vector is sorted in the process.
+ */
+void kbindexer::add_reach(crc_t crc, uint32_t filenum,
+			  vector<uint32_t>& exports)
+{
+	kbreachset& rs = m_reach[crc];
+	size_t mid = rs.exports.size();
+
+	sort(exports.begin(), exports.end());
+	exports.erase(unique(exports.begin(), exports.end()), exports.end());
+
+	rs.exports.insert(rs.exports.end(), exports.begin(), exports.end());
+	inplace_merge(rs.exports.begin(), rs.exports.begin() + mid,
+		      rs.exports.end());
+	rs.exports.erase(unique(rs.exports.begin(), rs.exports.end()),
+			 rs.exports.end());
+	rs.files.push_back(filenum);
+}
+
+/******************************************************************************
+ * kbindexer::get_export(crc_t crc, const char *name)
+ *
+ * Returns the number of the exported function, giving it the next one if
+ * it has not been seen before. They are renumbered in crc order when the
+ * reachability index is written.
+ */
+uint32_t kbindexer::get_export(crc_t crc, const char *name)
+{
+	auto it = m_expids.find(crc);
+
+	if (it != m_expids.end())
+		return it->second;
+
+	uint32_t id = m_exports.size();
+
+	m_expids[crc] = id;
+	m_exports.push_back(make_pair(crc, string(name)));
+	return id;
+}
+
+/******************************************************************************
+ * kbindexer::add_catalog(crc_t crc, string& name, string& source,
+ *			  uint32_t signature, uint32_t filenum, uint32_t dnode)
+ *
+ * Add an exported function of the graph file numbered filenum to the
+ * catalog.
+ */
+void kbindexer::add_catalog(crc_t crc, const string& name,
+			    const string& source, uint32_t signature,
+			    uint32_t filenum, uint32_t dnode)
+{
+	auto mit = m_modules.find(name);
+	kbcatrec cr;
+
+	memset(&cr, 0, sizeof(cr));
+	cr.crc = crc;
+	cr.name = m_catstrings.add(name);
+	cr.file = filenum;
+	cr.source = m_catstrings.add(source);
+	cr.module = (mit != m_modules.end()) ? m_catstrings.add(mit->second) : 0;
+	cr.signature = signature;
+	cr.dnode = dnode;
+	m_catrecs.push_back(cr);
+}
+
+/******************************************************************************
+ * kbindexer::read_symvers(string& filename)
+ *
+ * Get the module of each exported symbol from Module.symvers, where each
+ * line is the crc, symbol, module and export type. It must be read before
+ * the graph files are added. It is not an error if there is none.
+ */
+void kbindexer::read_symvers(const string& filename)
+{
+	ifstream ifs(filename);
+	string line;
+
+	while (getline(ifs, line)) {
+		istringstream iss(line);
+		string crc, symbol, module;
+
+		if (iss >> crc >> symbol >> module)
+			m_modules[symbol] = module;
+	}
+}
+
+/******************************************************************************
+ * kbindexer::put_bitmap(vector<uint32_t>& nums)
+ *
+ * Add the compressed bitmap of the ascending numbers in nums to m_conts
+ * and m_words, unless the same bitmap is already there.
+ */
+kbbmref kbindexer::put_bitmap(const vector<uint32_t>& nums)
+{
+	auto it = m_bitmaps.find(nums);
+	kbbmref ref;
+
+	if (it != m_bitmaps.end())
+		return it->second;
+
+	ref.first = m_conts.size();
+
+	for (size_t i = 0; i < nums.size(); ) {
+		kbbmcont bc;
+		size_t end = i;
+
+		memset(&bc, 0, sizeof(bc));
+		bc.key = nums[i] >> 16;
+
+		while ((end < nums.size()) && ((nums[end] >> 16) == bc.key))
+			++end;
+
+		bc.card = end - i;
+		bc.isbitmap = bc.card > KB_BM_ARRAYMAX;
+		bc.offset = m_words.size();
+
+		if (bc.isbitmap) {
+			m_words.resize(m_words.size() + KB_BM_WORDS);
+			uint16_t *words = &m_words[bc.offset];
+
+			for (; i < end; ++i)
+				words[(nums[i] & 0xFFFF) / 16] |=
+					1 << (nums[i] % 16);
+		} else {
+			for (; i < end; ++i)
+				m_words.push_back(nums[i] & 0xFFFF);
+		}
+
+		m_conts.push_back(bc);
+	}
+
+	ref.count = m_conts.size() - ref.first;
+	m_bitmaps[nums] = ref;
+	return ref;
+}
+
+int kbindexer::write(const string& filename)
+{
+	kbsecwriter kbw;
+	kbstrpool strings;
+	vector<uint32_t> files;
+	vector<kbidxrec> crcs;
+	vector<uint32_t> postings;
+
+	for (auto& file : m_files)
+		files.push_back(strings.add(file));
+
+	crcs.reserve(m_postings.size());
+
+	for (auto& it : m_postings) {
+		kbidxrec ir;
+
+		memset(&ir, 0, sizeof(ir));
+		ir.crc = it.first;
+		ir.first = postings.size();
+		ir.count = it.second.size();
+		crcs.push_back(ir);
+		postings.insert(postings.end(), it.second.begin(), it.second.end());
+	}
+
+	if (!kbw.open(filename)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_STRINGS, strings.pool().data(), strings.pool().size());
+	kbw.add(KBS_IDXFILES, files.data(), files.size() * sizeof(uint32_t));
+	kbw.add(KBS_IDXCRCS, crcs.data(), crcs.size() * sizeof(kbidxrec));
+	kbw.add(KBS_IDXPOSTINGS, postings.data(),
+		postings.size() * sizeof(uint32_t));
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int kbindexer::write_catalog(const string& filename)
+{
+	kbsecwriter kbw;
+	kbstrpool& strings = m_catstrings;
+	vector<uint32_t> files;
+
+	for (auto& file : m_files)
+		files.push_back(strings.add(file));
+
+	sort(m_catrecs.begin(), m_catrecs.end(),
+		[&strings](const kbcatrec& lhs, const kbcatrec& rhs) {
+			int cmp = strcmp(&strings.pool()[lhs.name],
+					 &strings.pool()[rhs.name]);
+			return cmp ? (cmp < 0) : (lhs.file < rhs.file);
+		});
+
+	if (!kbw.open(filename)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_STRINGS, strings.pool().data(), strings.pool().size());
+	kbw.add(KBS_IDXFILES, files.data(), files.size() * sizeof(uint32_t));
+	kbw.add(KBS_CATEXPORTS, m_catrecs.data(),
+		m_catrecs.size() * sizeof(kbcatrec));
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int kbindexer::write_bloom(const string& filename)
+{
+	kbsecwriter kbw;
+	kbstrpool strings;
+	vector<kbblmrec> recs;
+
+	for (auto& it : m_blmrecs) {
+		kbblmrec br = it.second;
+
+		br.name = strings.add(it.first);
+		recs.push_back(br);
+	}
+
+	if (!kbw.open(filename)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_STRINGS, strings.pool().data(), strings.pool().size());
+	kbw.add(KBS_BLMFILES, recs.data(), recs.size() * sizeof(kbblmrec));
+	kbw.add(KBS_BLMBITS, m_blmbits.data(),
+		m_blmbits.size() * sizeof(uint64_t));
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int kbindexer::write_reach(const string& filename)
+{
+	kbsecwriter kbw;
+	kbstrpool strings;
+	vector<uint32_t> files;
+	vector<kbrchexp> exports;
+	vector<kbrchrec> crcs;
+	vector<uint32_t> order(m_exports.size());
+	vector<uint32_t> newids(m_exports.size());
+
+	for (auto& file : m_files)
+		files.push_back(strings.add(file));
+
+	// The exported functions are numbered in crc order.
+	for (uint32_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	sort(order.begin(), order.end(),
+		[this](uint32_t lhs, uint32_t rhs) {
+			return m_exports[lhs].first < m_exports[rhs].first;
+		});
+
+	for (uint32_t i = 0; i < order.size(); ++i) {
+		kbrchexp re;
+
+		memset(&re, 0, sizeof(re));
+		re.crc = m_exports[order[i]].first;
+		re.name = strings.add(m_exports[order[i]].second);
+		exports.push_back(re);
+		newids[order[i]] = i;
+	}
+
+	crcs.reserve(m_reach.size());
+
+	for (auto& it : m_reach) {
+		vector<uint32_t> ids;
+		kbrchrec rr;
+
+		for (uint32_t id : it.second.exports)
+			ids.push_back(newids[id]);
+
+		sort(ids.begin(), ids.end());
+
+		memset(&rr, 0, sizeof(rr));
+		rr.crc = it.first;
+		rr.exports = put_bitmap(ids);
+		rr.files = put_bitmap(it.second.files);
+		crcs.push_back(rr);
+	}
+
+	if (!kbw.open(filename)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_STRINGS, strings.pool().data(), strings.pool().size());
+	kbw.add(KBS_IDXFILES, files.data(), files.size() * sizeof(uint32_t));
+	kbw.add(KBS_RCHEXPORTS, exports.data(),
+		exports.size() * sizeof(kbrchexp));
+	kbw.add(KBS_RCHCRCS, crcs.data(), crcs.size() * sizeof(kbrchrec));
+	kbw.add(KBS_RCHCONTS, m_conts.data(),
+		m_conts.size() * sizeof(kbbmcont));
+	kbw.add(KBS_RCHWORDS, m_words.data(),
+		m_words.size() * sizeof(uint16_t));
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+/***********************************
+**  Global functions
+***********************************/
+
+/******************************************************************************
+ * kb_get_index_name(string& filelist)
+ *
+ * The index sits next to the file list it was made from, with the same
+ * name stem, e.g. redhat/kabi/kabi-datafiles.idx
+ */
+string kb_get_index_name(const string& filelist)
+{
+	return get_sidecar_name(filelist, ".idx");
+}
+
+/******************************************************************************
+ * kb_get_bloom_name(string& filelist)
+ *
+ * The Bloom manifest sits next to the index, e.g.
+ * redhat/kabi/kabi-datafiles.blm
+ */
+string kb_get_bloom_name(const string& filelist)
+{
+	return get_sidecar_name(filelist, ".blm");
+}
+
+/******************************************************************************
+ * kb_get_whitelist_name(string& kabidir)
+ *
+ * The white list cache sits next to the white lists, in redhat/kabi/
+ */
+string kb_get_whitelist_name(const string& kabidir)
+{
+	return kabidir + "kabi-whitelist.wlc";
+}
+
+/******************************************************************************
+ * kb_get_subindex_name(string& graph)
+ *
+ * The substring index sits next to the kernel-wide graph it was made from,
+ * e.g. redhat/kabi/kabi-data.sub
+ */
+string kb_get_subindex_name(const string& graph)
+{
+	return get_sidecar_name(graph, ".sub");
+}
+
+/******************************************************************************
+ * kb_write_subindex(string& filename, string& graph, dnodemap& dnmap)
+ *
+ * Write the substring index of the dnodemap, which must be what the graph
+ * file holds. The graph file is measured first, so that the index can tell
+ * when the graph changes under it.
+ */
+int kb_write_subindex(const string& filename, const string& graph,
+		      dnodemap& dnmap)
+{
+	unordered_map<uint32_t, vector<uint32_t> > grams;
+	vector<uint64_t> crcs;
+	vector<kbgramrec> recs;
+	vector<uint8_t> postings;
+	kbsecwriter kbw;
+	kbsubinfo info;
+	struct stat st;
+
+	if (stat(graph.c_str(), &st)) {
+		cout << "Cannot open file: " << graph << endl;
+		return -1;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.size = st.st_size;
+	info.mtime = get_mtime(st);
+	crcs.reserve(dnmap.size());
+
+	for (auto& it : dnmap) {
+		dnode& dn = it.second;
+		uint32_t num = crcs.size();
+
+		crcs.push_back(it.first);
+		add_grams(grams, KB_SUB_DECL, kb_str(dn.decl), num);
+
+		if (dn.siblings.empty())
+			continue;
+
+		cnode& cn = dn.siblings.begin()->second;
+
+		if (cn.level == LVL_EXPORTED)
+			add_grams(grams, KB_SUB_EXPORT, kb_str(cn.name), num);
+	}
+
+	recs.reserve(grams.size());
+
+	for (auto& it : grams) {
+		kbgramrec gr;
+
+		memset(&gr, 0, sizeof(gr));
+		gr.gram = it.first;
+		recs.push_back(gr);
+	}
+
+	sort(recs.begin(), recs.end(),
+		[](const kbgramrec& lhs, const kbgramrec& rhs) {
+			return lhs.gram < rhs.gram;
+		});
+
+	for (auto& gr : recs) {
+		vector<uint32_t>& nums = grams[gr.gram];
+		uint32_t prev = 0;
+
+		gr.count = nums.size();
+		gr.offset = postings.size();
+
+		for (uint32_t num : nums) {
+			put_varint(postings, num - prev);
+			prev = num;
+		}
+
+		gr.size = postings.size() - gr.offset;
+		vector<uint32_t>().swap(nums);
+	}
+
+	if (!kbw.open(filename)) {
+		cout << "Cannot open file: " << filename << endl;
+		return -1;
+	}
+
+	kbw.add(KBS_SUBINFO, &info, sizeof(info));
+	kbw.add(KBS_SUBCRCS, crcs.data(), crcs.size() * sizeof(uint64_t));
+	kbw.add(KBS_SUBGRAMS, recs.data(), recs.size() * sizeof(kbgramrec));
+	kbw.add(KBS_SUBPOSTINGS, postings.data(), postings.size());
+
+	if (!kbw.close()) {
+		cout << "Cannot write file: " << filename << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * kb_get_reach_name(string& filelist)
+ *
+ * The reachability index sits next to the index, e.g.
+ * redhat/kabi/kabi-datafiles.rch
+ */
+string kb_get_reach_name(const string& filelist)
+{
+	return get_sidecar_name(filelist, ".rch");
+}
+
+/******************************************************************************
+ * kb_get_catalog_name(string& filelist)
+ *
+ * The export catalog sits next to the index, e.g.
+ * redhat/kabi/kabi-datafiles.cat
+ */
+string kb_get_catalog_name(const string& filelist)
+{
+	return get_sidecar_name(filelist, ".cat");
+}
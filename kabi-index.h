@@ -0,0 +1,476 @@
+/* kabi-index.h - index of the graph files for kabi-lookup
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef KABIINDEX_H
+#define KABIINDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "kabi-bin.h"
+
+/*
+ * The index is a sidecar of the file list. It maps the crc of every dnode
+ * to the graph files that contain it, so a whole word search only needs
+ * to read the files that have the symbol. It uses the sectioned layout
+ * described in kabi-bin.h with the following sections.
+ *
+ *   KBS_STRINGS     - string pool for the file names
+ *   KBS_IDXFILES    - uint32_t offset in KBS_STRINGS of each graph file,
+ *                     in the order of the file list
+ *   KBS_IDXCRCS     - kbidxrec array, sorted by crc
+ *   KBS_IDXPOSTINGS - uint32_t file numbers. The files of each crc are a
+ *                     contiguous run, in ascending order.
+ */
+
+struct kbidxrec {
+	uint64_t crc;
+	uint32_t first;		// index of first file number in KBS_IDXPOSTINGS
+	uint32_t count;
+};
+
+/*
+ * The Bloom manifest is another sidecar of the file list, with a Bloom
+ * filter of the dnode crcs of each graph file. Exported symbols are dnodes
+ * too, so they are in it by the crc of their names. The index is dropped
+ * as a whole when the file list changes, but each filter is only dropped
+ * when the size or modification time of its own graph file changes, so
+ * the filters of the untouched files still spare them from being read.
+ *
+ *   KBS_STRINGS  - string pool for the file names
+ *   KBS_BLMFILES - kbblmrec array, in the order of the file list
+ *   KBS_BLMBITS  - uint64_t words of the filters. The words of each file
+ *                  are a contiguous run.
+ */
+
+#define KB_BLOOM_BITS	10	// bits per crc, for about 1% false positives
+#define KB_BLOOM_HASHES	7
+
+struct kbblmrec {
+	uint32_t name;		// offset in KBS_STRINGS
+	uint32_t nhashes;
+	uint64_t first;		// index of first word in KBS_BLMBITS
+	uint64_t nwords;
+	uint64_t size;		// of the graph file when it was filtered
+	int64_t mtime;		// ditto, in nanoseconds
+};
+
+/*
+ * The reachability index is the third sidecar of the file list. For the
+ * crc of every dnode, it has the exported functions whose hierarchy the
+ * dnode is in, and the graph files where it is, as compressed bitmaps.
+ * The exported functions are numbered across the whole file list.
+ *
+ *   KBS_STRINGS    - string pool for the file and function names
+ *   KBS_IDXFILES   - as in the index
+ *   KBS_RCHEXPORTS - kbrchexp array, sorted by crc. The position of an
+ *                    exported function in it is its number.
+ *   KBS_RCHCRCS    - kbrchrec array, sorted by crc
+ *   KBS_RCHCONTS   - kbbmcont array, the containers of the bitmaps
+ *   KBS_RCHWORDS   - uint16_t contents of the containers
+ *
+ * A bitmap is split into containers by the upper 16 bits of its numbers,
+ * as in a Roaring bitmap. A container of up to KB_BM_ARRAYMAX numbers is
+ * an ascending array of their lower 16 bits. A fuller one is a bitmap of
+ * all 65536 of them, which is smaller by then. Bitmaps that are the same
+ * are stored only once.
+ */
+
+#define KB_BM_ARRAYMAX	4096
+#define KB_BM_WORDS	(65536 / 16)	// uint16_t words of a bitmap container
+
+struct kbbmref {
+	uint32_t first;		// index of first container in KBS_RCHCONTS
+	uint32_t count;
+};
+
+struct kbbmcont {
+	uint16_t key;		// upper 16 bits of the numbers
+	uint16_t isbitmap;
+	uint32_t card;		// how many numbers
+	uint64_t offset;	// index of first word in KBS_RCHWORDS
+};
+
+struct kbrchexp {
+	uint64_t crc;
+	uint32_t name;		// offset in KBS_STRINGS
+	uint32_t reserved;
+};
+
+struct kbrchrec {
+	uint64_t crc;
+	kbbmref exports;
+	kbbmref files;
+};
+
+/*
+ * The export catalog is the fourth sidecar of the file list. It has every
+ * exported function of every graph file, sorted by name, so the files that
+ * export a function can be found without reading any of them, and the
+ * exports of a file or module can be listed.
+ *
+ *   KBS_STRINGS    - string pool for the file, function, source file and
+ *                    module names
+ *   KBS_IDXFILES   - as in the index
+ *   KBS_CATEXPORTS - kbcatrec array, sorted by name, then by file number
+ *
+ * The module of an export is taken from Module.symvers, if there is one.
+ * The signature is the crc of the declarations of the return and arguments
+ * of the function, as kabi-lookup -e prints them, so it changes when any of
+ * them does.
+ */
+
+#define KB_CAT_NODNODE	0xFFFFFFFF	// the graph file is not a binary graph
+
+struct kbcatrec {
+	uint64_t crc;		// of the exported function, that of its name
+	uint32_t name;		// offset in KBS_STRINGS
+	uint32_t file;		// number of the graph file in KBS_IDXFILES
+	uint32_t source;	// offset in KBS_STRINGS of the source file
+	uint32_t module;	// offset in KBS_STRINGS of the module, or 0
+	uint32_t signature;
+	uint32_t dnode;		// index in KBS_DNODES of the graph file
+};
+
+/*
+ * The substring index is a sidecar of a kernel-wide graph from kabi-merge,
+ * e.g. redhat/kabi/kabi-data.sub. It maps each trigram of the decl of each
+ * dnode, and of the name of each exported function, to the dnodes that have
+ * it. A substring search then only has to look at the dnodes that have all
+ * the trigrams of the symbol. Symbols shorter than a trigram cannot use it.
+ *
+ *   KBS_SUBINFO     - kbsubinfo of the graph file it was made from
+ *   KBS_SUBCRCS     - uint64_t crc of each dnode, ascending. The position
+ *                     of a crc is its number in the posting lists.
+ *   KBS_SUBGRAMS    - kbgramrec array, sorted by gram
+ *   KBS_SUBPOSTINGS - the ascending dnode numbers of each gram, each coded
+ *                     as a varint of its difference from the one before.
+ */
+
+enum kbsubkind {
+	KB_SUB_DECL,		// dnode::decl
+	KB_SUB_EXPORT,		// name of an exported function
+};
+
+struct kbsubinfo {
+	uint64_t size;		// of the graph file
+	int64_t mtime;		// ditto, in nanoseconds
+};
+
+struct kbgramrec {
+	uint32_t gram;		// kbsubkind << 24, then the three characters
+	uint32_t count;		// how many dnodes have it
+	uint64_t offset;	// of the first byte in KBS_SUBPOSTINGS
+	uint64_t size;		// in bytes
+};
+
+/*
+ * The white list cache holds the symbols of the Module.kabi* white lists
+ * in redhat/kabi, in a minimal perfect hash table, e.g.
+ * redhat/kabi/kabi-whitelist.wlc. It is made by kabi-lookup the first time
+ * it needs the white lists, and again whenever a white list is added,
+ * removed or changed.
+ *
+ *   KBS_STRINGS    - string pool for the white lists and the symbols
+ *   KBS_WHTSOURCES - kbwhtsrc array of the white lists, sorted by name
+ *   KBS_WHTDISPS   - int32_t displacement of each bucket, see below
+ *   KBS_WHTSLOTS   - uint32_t offset in KBS_STRINGS of the symbol in each
+ *                    slot. There are as many slots as symbols.
+ *
+ * A symbol hashes to a bucket. A bucket with one symbol has the slot of
+ * the symbol as its displacement, coded as -(slot + 1). A bucket with more
+ * than one has the seed that hashes each of them to a slot of its own. A
+ * bucket with none has 0. Whether a symbol is white listed then takes two
+ * hashes and one string compare.
+ */
+
+struct kbwhtsrc {
+	uint32_t name;		// offset in KBS_STRINGS
+	uint32_t reserved;
+	uint64_t size;		// of the white list when it was read
+	int64_t mtime;		// ditto, in nanoseconds
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbindex is the read-only view of the index used by kabi-lookup.
+//
+class kbindex
+{
+public:
+	kbindex(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); }
+	bool is_open() const { return m_file.is_open(); }
+
+	size_t size() const { return m_filecount; }
+	const char *file(size_t index) const;
+	bool find(crc_t crc, std::vector<uint32_t>& files) const;
+
+private:
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const uint32_t *m_files = NULL;
+	size_t m_filecount = 0;
+	const kbidxrec *m_crcs = NULL;
+	size_t m_crccount = 0;
+	const uint32_t *m_postings = NULL;
+	size_t m_postcount = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbbloom is the read-only view of the Bloom manifest used by kabi-lookup.
+//
+class kbbloom
+{
+public:
+	kbbloom(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); m_names.clear(); }
+	bool is_open() const { return m_file.is_open(); }
+
+	bool may_have(const std::string& datafile, crc_t crc) const;
+
+private:
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const kbblmrec *m_recs = NULL;
+	size_t m_reccount = 0;
+	const uint64_t *m_bits = NULL;
+	size_t m_bitcount = 0;
+	std::unordered_map<std::string, uint32_t> m_names;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbreach is the read-only view of the reachability index used by
+// kabi-lookup.
+//
+class kbreach
+{
+public:
+	kbreach(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); }
+	bool is_open() const { return m_file.is_open(); }
+
+	size_t size() const { return m_filecount; }
+	const char *file(size_t index) const;
+	const char *export_name(uint32_t id) const;
+	bool find(crc_t crc, std::vector<uint32_t>& exports,
+		  std::vector<uint32_t>& files) const;
+
+private:
+	void get_bitmap(const kbbmref& ref, std::vector<uint32_t>& nums) const;
+
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const uint32_t *m_files = NULL;
+	size_t m_filecount = 0;
+	const kbrchexp *m_exports = NULL;
+	size_t m_expcount = 0;
+	const kbrchrec *m_crcs = NULL;
+	size_t m_crccount = 0;
+	const kbbmcont *m_conts = NULL;
+	size_t m_contcount = 0;
+	const uint16_t *m_words = NULL;
+	size_t m_wordcount = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbcatalog is the read-only view of the export catalog used by kabi-lookup.
+//
+class kbcatalog
+{
+public:
+	kbcatalog(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); }
+	bool is_open() const { return m_file.is_open(); }
+
+	size_t size() const { return m_filecount; }
+	const char *file(size_t index) const;
+	size_t count() const { return m_reccount; }
+	const kbcatrec& rec(size_t index) const { return m_recs[index]; }
+	const char *str(uint32_t offset) const { return &m_strings[offset]; }
+	void find_prefix(const std::string& prefix,
+			 size_t *first, size_t *last) const;
+
+private:
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const uint32_t *m_files = NULL;
+	size_t m_filecount = 0;
+	const kbcatrec *m_recs = NULL;
+	size_t m_reccount = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbsubindex is the read-only view of the substring index used by
+// kabi-lookup.
+//
+class kbsubindex
+{
+public:
+	kbsubindex(){}
+
+	bool open(const std::string& filename);
+	void close() { m_file.close(); }
+	bool is_open() const { return m_file.is_open(); }
+
+	bool is_current(const std::string& graph) const;
+	bool find(const std::string& str, kbsubkind kind,
+		  std::vector<crc_t>& crcs) const;
+
+private:
+	void get_postings(const kbgramrec& gr,
+			  std::vector<uint32_t>& nums) const;
+
+	kbsecfile m_file;
+	const kbsubinfo *m_info = NULL;
+	const uint64_t *m_crcs = NULL;
+	size_t m_crccount = 0;
+	const kbgramrec *m_grams = NULL;
+	size_t m_gramcount = 0;
+	const uint8_t *m_postings = NULL;
+	size_t m_postsize = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbwhitelist is the white list cache used by kabi-lookup. It is either
+// read from the cache file, or built from the symbols and then written to
+// it.
+//
+class kbwhitelist
+{
+public:
+	kbwhitelist(){}
+
+	bool open(const std::string& filename);
+	void close();
+	bool is_open() const { return m_slots != NULL; }
+
+	bool is_current(const std::vector<std::string>& sources) const;
+	void build(const std::vector<std::string>& symbols);
+	int write(const std::string& filename,
+		  const std::vector<std::string>& sources) const;
+	bool has(const char *symbol) const;
+	bool has(const std::string& symbol) const
+	{
+		return has(symbol.c_str());
+	}
+
+private:
+	kbsecfile m_file;
+	const char *m_strings = NULL;
+	size_t m_strsize = 0;
+	const kbwhtsrc *m_sources = NULL;
+	size_t m_srccount = 0;
+	const int32_t *m_disps = NULL;
+	size_t m_dispcount = 0;
+	const uint32_t *m_slots = NULL;
+	size_t m_slotcount = 0;
+
+	// The table made by build(), before it is written
+	kbstrpool m_pool;
+	std::vector<int32_t> m_heapdisps;
+	std::vector<uint32_t> m_heapslots;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbindexer collects the crcs of each graph file and writes the index, the
+// Bloom manifest, the reachability index and the export catalog.
+//
+class kbindexer
+{
+public:
+	kbindexer(){}
+
+	int add_file(const std::string& datafile);
+	int write(const std::string& filename);
+	int write_bloom(const std::string& filename);
+	int write_reach(const std::string& filename);
+	int write_catalog(const std::string& filename);
+	void read_symvers(const std::string& filename);
+
+private:
+	// The exported functions and files that reach a crc, see add_reach()
+	struct kbreachset {
+		std::vector<uint32_t> exports;
+		std::vector<uint32_t> files;
+	};
+
+	void add_bloom(const std::string& datafile, const struct stat& st,
+		       const std::vector<crc_t>& crcs);
+	void add_reach(crc_t crc, uint32_t filenum,
+		       std::vector<uint32_t>& exports);
+	uint32_t get_export(crc_t crc, const char *name);
+	void add_catalog(crc_t crc, const std::string& name,
+			 const std::string& source, uint32_t signature,
+			 uint32_t filenum, uint32_t dnode);
+	kbbmref put_bitmap(const std::vector<uint32_t>& nums);
+
+	std::vector<std::string> m_files;
+	std::map<crc_t, std::vector<uint32_t> > m_postings;
+	std::vector<std::pair<std::string, kbblmrec> > m_blmrecs;
+	std::vector<uint64_t> m_blmbits;
+	std::vector<crc_t> m_crcs;	// of the current file
+	std::map<crc_t, kbreachset> m_reach;
+	std::unordered_map<crc_t, uint32_t> m_expids;
+	std::vector<std::pair<crc_t, std::string> > m_exports;
+	std::map<std::vector<uint32_t>, kbbmref> m_bitmaps;
+	std::vector<kbbmcont> m_conts;
+	std::vector<uint16_t> m_words;
+	std::vector<kbcatrec> m_catrecs;
+	kbstrpool m_catstrings;
+	std::unordered_map<std::string, std::string> m_modules;
+	dnodemap m_dnmap;
+};
+
+/*****************************************
+** Function Prototypes
+*****************************************/
+
+extern std::string kb_get_index_name(const std::string& filelist);
+extern std::string kb_get_bloom_name(const std::string& filelist);
+extern std::string kb_get_reach_name(const std::string& filelist);
+extern std::string kb_get_catalog_name(const std::string& filelist);
+extern std::string kb_get_subindex_name(const std::string& graph);
+extern std::string kb_get_whitelist_name(const std::string& kabidir);
+extern int kb_write_subindex(const std::string& filename,
+			     const std::string& graph, dnodemap& dnmap);
+
+#endif // KABIINDEX_H
@@ -20,27 +20,59 @@
  */
 
 #include <map>
+#include <climits>
 #include <cstring>
+#include <unistd.h>
 #include <fstream>
 #include <iostream>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/map.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
 
 #include "checksum.h"
 #include "kabi-map.h"
+#include "kabi-bin.h"
+#include "kabi-store.h"
+#include "kabi-text.h"
 
 #define NDEBUG
 
 using namespace std;
 
-dnodemap public_dnodemap;
-static int order = 0;
+static kbparsectx public_ctx;
+static kbparsectx *parsectx = &public_ctx;	// see kb_set_parsectx()
+static bool binmap = false;
+static bool zstdmap = false;
+static const kbgraph *lazygraph = NULL;
+static string typestore;
 
 /***********************************
 **  Class encapsulated functions
 ***********************************/
 
+strtab::strtab()
+{
+	intern("");
+}
+
+strid_t strtab::intern(const string& str)
+{
+	auto it = m_index.find(&str);
+
+	if (it != m_index.end())
+		return it->second;
+
+	strid_t id = m_strings.size();
+	m_strings.push_back(str);
+	m_index.insert(make_pair(&m_strings.back(), id));
+	return id;
+}
+
 void cnode::operator = (const cnode& cn)
 {
 	function = cn.function;
@@ -51,6 +83,7 @@ void cnode::operator = (const cnode& cn)
 	name = cn.name;
 	parent = cn.parent;
 	sibling = cn.sibling;
+	file = cn.file;
 }
 
 bool cnode::operator ==(const cnode& cn) const
@@ -74,6 +107,7 @@ void dnode::operator = (const dnode& dn)
 	decl = dn.decl;
 	siblings.insert(dn.siblings.begin(), dn.siblings.end());
 	children.insert(dn.children.begin(), dn.children.end());
+	typedigest = dn.typedigest;
 }
 
 bool dnode::operator ==(const dnode& dn) const
@@ -98,8 +132,8 @@ void dnode::insert(dnodemap& dnmap, dnpair_p dnp_p)
 
 static dnpair* lookup_dnode(crc_t crc)
 {
-	dniterator dnit = public_dnodemap.find(crc);
-	return dnit == public_dnodemap.end() ? NULL : &(*dnit);
+	dniterator dnit = parsectx->dnmap.find(crc);
+	return dnit == parsectx->dnmap.end() ? NULL : &(*dnit);
 }
 
 static inline dnpair* insert_dnode(dnodemap& dnmap, dnpair dnp)
@@ -135,8 +169,10 @@ static void insert_node(Tmap& xnodemap, Tpair xpair)
  */
 static inline sparm* alloc_sparm()
 {
-	sparm *sp = new sparm;
-	dnode *dn = new dnode;
+	parsectx->sparms.emplace_back();
+	parsectx->dnodes.emplace_back();
+	sparm *sp = &parsectx->sparms.back();
+	dnode *dn = &parsectx->dnodes.back();
 	sp->dnode = (void*)dn;	// dnode descriptor of this declaration
 	return sp;
 }
@@ -146,10 +182,11 @@ static inline cnode* alloc_cnode(crc_t function,
 				 int level,
 				 int order,
 				 ctlflags flags,
-				 string name)
+				 strid_t name)
 {
-	cnode *cn = new cnode(function, argument, level, order, flags, name);
-	return cn;
+	parsectx->cnodes.emplace_back(function, argument, level, order,
+				      flags, name);
+	return &parsectx->cnodes.back();
 }
 
 static inline
@@ -159,7 +196,7 @@ sparm* init_sparm(sparm* parent, sparm *sp, enum ctlflags flags)
 	sp->symlist = NULL;
 	sp->flags   = flags;
 	sp->level = parent->level+1;
-	sp->order = ++order;
+	sp->order = ++parsectx->order;
 	return sp;
 }
 
@@ -188,7 +225,7 @@ sparm* init_sparm(sparm* parent, sparm *sp, enum ctlflags flags)
  *	dyn <- child cnode
  *	step <- SK_CHILD
  */
-bool kb_is_adjacent(cnode& ref, cnode& dyn, skdir step)
+bool kb_is_adjacent(const cnode& ref, const cnode& dyn, skdir step)
 {
 	int nextlevel = ref.level + step;
 
@@ -290,24 +327,26 @@ struct sparm *kb_new_firstsparm(char *file)
 	sp->name = "";
 	sp->decl = file;
 	sp->level = LVL_FILE;
-	sp->order = ++order;
+	sp->order = ++parsectx->order;
 	sp->flags = CTL_FILE;
 	sp->crc = raw_crc32(file);
 	sp->argument = 0;
 	sp->function = 0;
 
 	dn = (dnode*)sp->dnode;
-	dn->decl = sp->decl;
+	dn->decl = kb_intern(sp->decl);
 
 	crc_t func = sp->function;
 	crc_t arg  = sp->argument;
-	cn = alloc_cnode(func, arg, sp->level, sp->order, sp->flags, sp->name);
+	cn = alloc_cnode(func, arg, sp->level, sp->order, sp->flags,
+			 kb_intern(sp->name));
 	cn->sibling = make_pair(sp->order, sp->crc);
 	cn->parent = make_pair(0,0);
+	cn->file = sp->crc;
 	sp->cnode = (void *)cn;
 
 	cnp = insert_cnode(dn->siblings, make_pair(sp->order, *cn));
-	dnp = insert_dnode(public_dnodemap, make_pair(sp->crc, *dn));
+	dnp = insert_dnode(parsectx->dnmap, make_pair(sp->crc, *dn));
 
 	sp->cnode = (void *)&cnp->second;
 	sp->dnode = (void *)&dnp->second;
@@ -327,7 +366,7 @@ struct sparm *kb_new_firstsparm(char *file)
  * and kabi::get_declist.
  * If the dnode is the first of its type, as characterized by its CRC, its
  * cnode will be the first entry in its siblings cnodemap, and the dnode
- * will be inserted into the public_dnodemap.
+ * will be inserted into the dnodemap of the current context.
  * If not, the original dnode will get this dnode's cnode inserted into its
  * siblings cnodemap, and the dnode for this symbol will be dropped on the
  * floor.
@@ -377,11 +416,13 @@ void kb_update_nodes(struct sparm *sp, struct sparm *parent)
 	// Extract the declaration string from the one stored in the dnode
 	// by kabi.c::get_declist and store it in the sparm.decl field to
 	// be passed back to the caller through this sparm,
-	sp->decl = dn->decl.c_str();
+	sp->decl = kb_str(dn->decl).c_str();
 
 	// Create a cnode for this declaration.
-	cn = alloc_cnode(func, arg, sp->level, sp->order, sp->flags, sp->name);
+	cn = alloc_cnode(func, arg, sp->level, sp->order, sp->flags,
+			 kb_intern(sp->name));
 	cn->parent = make_pair(parent->order, parent->crc);
+	cn->file = ((cnode *)parent->cnode)->file;
 
 	// If we've seen this dnode before, use the cnodepair to lookup
 	// the original dnode instance and insert the cnode of the new
@@ -412,20 +453,53 @@ void kb_update_nodes(struct sparm *sp, struct sparm *parent)
 		insert_node(pdn->children, make_pair(sp->order, sp->crc));
 
 	// If this dnode is a dup or a backpointer, then return without
-	// inserting the dnode into the public_dnodemap, because there's
+	// inserting the dnode into the dnodemap, because there's
 	// already one there.
 	// All the hierarchical details of this node have been stored as a
 	// cnode in the original dnode's siblings cnodemap.
 	if (sp->flags & CTL_ISDUP)
 		return;
 
-	sib = insert_dnode(public_dnodemap, dnp);
+	sib = insert_dnode(parsectx->dnmap, dnp);
 	sp->dnode = (void *)&sib->second;
 }
 
 dnodemap& kb_get_public_dnodemap()
 {
-	return public_dnodemap;
+	return public_ctx.dnmap;
+}
+
+strtab& kb_get_strtab()
+{
+	return parsectx->strings;
+}
+
+/******************************************************************************
+ * kb_new_parsectx()
+ * kb_set_parsectx(struct kbparsectx *ctx)
+ * kb_free_parsectx(struct kbparsectx *ctx)
+ *
+ * A new context is empty. Setting it makes it current for all the functions
+ * here, until another is set. Setting NULL goes back to the public context.
+ * A context that is freed while it is current is replaced by the public one.
+ */
+struct kbparsectx *kb_new_parsectx()
+{
+	return new kbparsectx;
+}
+
+void kb_set_parsectx(struct kbparsectx *ctx)
+{
+	parsectx = ctx ? ctx : &public_ctx;
+}
+
+void kb_free_parsectx(struct kbparsectx *ctx)
+{
+	if (ctx == parsectx)
+		parsectx = &public_ctx;
+
+	if (ctx != &public_ctx)
+		delete ctx;
 }
 
 const char *kb_cstrcat(const char *d, const char *s)
@@ -434,34 +508,65 @@ const char *kb_cstrcat(const char *d, const char *s)
 		return s;
 	if (!s)
 		return d;
+	// Keep the result in the strings of the context, so that it outlives
+	// this call.
 	string dd = string(d) + " " + string(s);
-	return dd.c_str();
+	return kb_str(kb_intern(dd)).c_str();
 }
 
 void kb_add_to_decl(struct sparm *sp, char *decl)
 {
 	dnode* dn = (dnode *)sp->dnode;
-	if (dn->decl.size() != 0)
-		dn->decl += " ";
-	dn->decl += string(decl);
-	sp->decl = dn->decl.c_str();
+	string str = kb_str(dn->decl);
+	if (str.size() != 0)
+		str += " ";
+	str += string(decl);
+	dn->decl = kb_intern(str);
+	sp->decl = kb_str(dn->decl).c_str();
 }
 
 void kb_trim_decl(struct sparm *sp)
 {
 	dnode* dn = (dnode *)sp->dnode;
-	dn->decl.erase(dn->decl.find_last_not_of(' ') + 1);
+	string str = kb_str(dn->decl);
+	str.erase(str.find_last_not_of(' ') + 1);
+	dn->decl = kb_intern(str);
 }
 
 const char *kb_get_decl(struct sparm *sp)
 {
 	dnode* dn = (dnode *)sp->dnode;
-	return dn->decl.c_str();
+	return kb_str(dn->decl).c_str();
+}
+
+/******************************************************************************
+ * kb_set_lazy_graph(const kbgraph *kbg)
+ *
+ * While a binary graph is attached, kb_lookup_dnode() decodes each dnode
+ * from it into the public dnodemap the first time the dnode is looked up,
+ * so a search that only walks part of the graph only decodes that part.
+ * The public dnodemap must not hold dnodes of any other graph. The graph
+ * must stay open until it is detached by passing NULL.
+ */
+void kb_set_lazy_graph(const kbgraph *kbg)
+{
+	lazygraph = kbg;
 }
 
 dnode* kb_lookup_dnode(crc_t crc)
 {
 	dnpair* dnp = lookup_dnode(crc);
+
+	if (!dnp && lazygraph) {
+		const kbdnrec *dr = lazygraph->find(crc);
+
+		if (!dr)
+			return NULL;
+
+		dnp = insert_dnode(parsectx->dnmap, make_pair(crc, dnode()));
+		lazygraph->get_dnode(*dr, dnp->second);
+	}
+
 	if (!dnp)
 		return NULL;
 	return &dnp->second;
@@ -469,7 +574,7 @@ dnode* kb_lookup_dnode(crc_t crc)
 
 bool kb_is_dup(struct sparm *sp)
 {
-	dnodemap& dnmap = public_dnodemap;
+	dnodemap& dnmap = parsectx->dnmap;
 
 	if (sp->level <= LVL_ARG)
 		return false;
@@ -479,23 +584,242 @@ bool kb_is_dup(struct sparm *sp)
 	return dup;
 }
 
+/******************************************************************************
+ * find_file(dnodemap& dnmap, cnode& cn)
+ *
+ * Graphs written before cnodes carried the crc of their file must find it
+ * by climbing the hierarchy. The parent field holds the order and crc of
+ * the parent cnode, so each step up is exact.
+ */
+static crc_t find_file(dnodemap& dnmap, const cnode& cn)
+{
+	const cnode *pcn = &cn;
+
+	while (pcn->level > LVL_FILE) {
+		dniterator dnit = dnmap.find(pcn->parent.second);
+
+		if (dnit == dnmap.end())
+			return 0;
+
+		cniterator cnit = dnit->second.siblings.find(pcn->parent.first);
+
+		if (cnit == dnit->second.siblings.end())
+			return 0;
+
+		pcn = &cnit->second;
+	}
+
+	return pcn->sibling.second;
+}
+
+/******************************************************************************
+ * kb_merge_dnodemap(dnodemap& dst, dnodemap& src, int base)
+ *
+ * dst  - kernel-wide graph
+ * src  - graph of one or more files, as read from a graph file
+ * base - offset to add to the orders in src
+ *
+ * Returns the base for the next graph to be merged, or -1 if the orders
+ * of src would not fit in an int above base, as the binary graph stores
+ * them. Nothing is merged then.
+ *
+ * Orders are only unique within the graph of one kabi-parser run, so they
+ * are moved above the orders already in dst. Each dnode is stored once
+ * per crc. The cnodes of a dnode that is already in dst are added to its
+ * siblings, and each cnode keeps the crc of the file it came from.
+ *
+ * kabi-parser only records the children of a dnode under its first
+ * instance, and all later instances in the graph share them. The crc of a
+ * dnode is that of its declaration, so a struct of the same name can have
+ * other members in another graph. The children of every graph are kept,
+ * and kabi-lookup follows those from the file of the instance.
+ */
+int kb_merge_dnodemap(dnodemap& dst, dnodemap& src, int base)
+{
+	int top = base;
+	int srctop = 0;
+
+	if (base < 0)
+		return -1;
+
+	for (auto& it : src) {
+		for (auto& cnit : it.second.siblings) {
+			const cnode& cn = cnit.second;
+
+			srctop = max({ srctop, cnit.first, cn.order,
+				       cn.sibling.first, cn.parent.first });
+		}
+
+		if (!it.second.children.empty())
+			srctop = max(srctop, it.second.children.rbegin()->first);
+	}
+
+	if (srctop > INT_MAX - base)
+		return -1;
+
+	for (auto& it : src) {
+		dnode& sdn = it.second;
+		dnode mdn(sdn.decl);
+
+		for (auto& cnit : sdn.siblings) {
+			cnode cn = cnit.second;
+
+			if (!cn.file)
+				cn.file = find_file(src, cn);
+
+			cn.order += base;
+			cn.sibling.first += base;
+
+			if (cn.parent.second)
+				cn.parent.first += base;
+
+			top = max(top, cn.order);
+			insert_node(mdn.siblings, make_pair(cnit.first + base, cn));
+		}
+
+		for (auto& crcit : sdn.children)
+			insert_node(mdn.children,
+				    make_pair(crcit.first + base, crcit.second));
+
+		dniterator dnit = dst.find(it.first);
+
+		if (dnit == dst.end()) {
+			insert_node(dst, make_pair(it.first, mdn));
+			continue;
+		}
+
+		dnode& ddn = dnit->second;
+		ddn.siblings.insert(mdn.siblings.begin(), mdn.siblings.end());
+		ddn.children.insert(mdn.children.begin(), mdn.children.end());
+	}
+
+	return top;
+}
+
 /*******************************************
 **  Serialization and Extraction functions
 *******************************************/
 
-static inline void write_dnodemap(const char *filename, dnodemap dnmap)
+/******************************************************************************
+ * get_strings(dnodemap& dnmap, vector<pair<strid_t, string> >& strings)
+ *
+ * The strtab holds the strings of everything this program has seen, so an
+ * archive gets only the strings its dnodemap refers to, with their ids.
+ */
+static void get_strings(dnodemap& dnmap, vector<pair<strid_t, string> >& strings)
 {
-	ofstream ofs(filename, ofstream::out | ofstream::app);
-	if (!ofs.is_open()) {
-		cout << "Cannot open file: " << filename << endl;
+	strtab& st = kb_get_strtab();
+	vector<bool> used(st.size());
+
+	for (auto& it : dnmap) {
+		used[it.second.decl] = true;
+
+		for (auto& cnit : it.second.siblings)
+			used[cnit.second.name] = true;
+	}
+
+	for (strid_t id = 0; id < used.size(); ++id)
+		if (used[id])
+			strings.push_back(make_pair(id, st.str(id)));
+}
+
+/******************************************************************************
+ * put_strings(dnodemap& dnmap, vector<pair<strid_t, string> >& strings)
+ *
+ * Replace the ids of an archive that has just been loaded with the ids of
+ * the same strings in the strtab.
+ */
+static void put_strings(dnodemap& dnmap, vector<pair<strid_t, string> >& strings)
+{
+	unordered_map<strid_t, strid_t> ids;
+
+	for (auto& it : strings)
+		ids[it.first] = kb_intern(it.second);
+
+	for (auto& it : dnmap) {
+		it.second.decl = ids[it.second.decl];
+
+		for (auto& cnit : it.second.siblings)
+			cnit.second.name = ids[cnit.second.name];
+	}
+}
+
+/******************************************************************************
+ * kb_save_dnodemap(ostream& os, dnodemap& dnmap)
+ *
+ * Write the dnodemap as a text archive, followed by its strings, and by the
+ * path to the type store if any dnode refers to a type in it.
+ */
+void kb_save_dnodemap(ostream& os, dnodemap& dnmap)
+{
+	vector<pair<strid_t, string> > strings;
+	string storedir = kb_get_typestore(dnmap);
+
+	get_strings(dnmap, strings);
+
+	boost::archive::text_oarchive oa(os);
+	oa << dnmap;
+	oa << strings;
+
+	if (!storedir.empty())
+		oa << storedir;
+}
+
+/******************************************************************************
+ * kb_load_dnodemap(istream& is, dnodemap& dnmap)
+ *
+ * Read a text archive written by kb_save_dnodemap(), or by a version of
+ * kabi-parser that wrote the strings inline.
+ */
+int kb_load_dnodemap(istream& is, dnodemap& dnmap)
+{
+	boost::archive::text_iarchive ia(is);
+	vector<pair<strid_t, string> > strings;
+	string storedir;
+
+	kb_get_strtab().loaded_ids = false;
+	ia >> dnmap;
+
+	if (!kb_get_strtab().loaded_ids)
+		return 0;
+
+	ia >> strings;
+	put_strings(dnmap, strings);
+
+	if (!kb_has_typerefs(dnmap))
+		return 0;
+
+	ia >> storedir;
+	return kb_resolve_types(dnmap, storedir);
+}
+
+static inline void write_dnodemap(const char *filename, dnodemap& dnmap)
+{
+	if (!typestore.empty() && kb_store_types(dnmap, typestore) != 0)
 		exit(1);
+
+	if (binmap) {
+		if (kb_write_binmap(filename, dnmap, zstdmap) != 0)
+			exit(1);
+		return;
 	}
 
-	{
-		boost::archive::text_oarchive oa(ofs);
-		oa << dnmap;
+	boost::iostreams::file_sink sink(filename, ios_base::out |
+					 ios_base::app | ios_base::binary);
+	if (!sink.is_open()) {
+		cout << "Cannot open file: " << filename << endl;
+		exit(1);
 	}
-	ofs.close();
+
+	// The archive is compressed as it is written.
+	boost::iostreams::filtering_ostream out;
+
+	if (zstdmap)
+		out.push(boost::iostreams::zstd_compressor());
+
+	out.push(sink);
+	kb_save_dnodemap(out, dnmap);
+	out.reset();
 }
 
 void kb_write_dnodemap_other(string& filename, dnodemap& dnmap)
@@ -505,7 +829,33 @@ void kb_write_dnodemap_other(string& filename, dnodemap& dnmap)
 
 void kb_write_dnodemap(const char *filename)
 {
-	write_dnodemap(filename, public_dnodemap);
+	write_dnodemap(filename, parsectx->dnmap);
+}
+
+void kb_set_binmap(bool enable)
+{
+	binmap = enable;
+}
+
+void kb_set_zstdmap(bool enable)
+{
+	zstdmap = enable;
+}
+
+void kb_set_typestore(const char *storedir)
+{
+	char cwd[PATH_MAX];
+
+	// The path is kept in the graphs, which are read from anywhere.
+	if ((*storedir != '/') && getcwd(cwd, sizeof(cwd)))
+		typestore = string(cwd) + "/" + storedir;
+	else
+		typestore = storedir;
+}
+
+string kb_get_typestore(dnodemap& dnmap)
+{
+	return kb_has_typerefs(dnmap) ? typestore : string();
 }
 
 void kb_restore_dnodemap(char *filename)
@@ -516,113 +866,184 @@ void kb_restore_dnodemap(char *filename)
 				" will be created\n.", filename);
 		return;
 	}
+	ifs.close();
+
+	kb_read_dnodemap(filename, parsectx->dnmap);
+}
+
+/******************************************************************************
+ * read_textmap(string& filename, dnodemap& dnmap, int *status)
+ *
+ * Parse the text archive in memory with kbtextreader, which is several
+ * times faster than boost. Returns false if the archive is not laid out
+ * the way kbtextreader expects, so that boost can read it instead.
+ */
+static bool read_textmap(const string& filename, dnodemap& dnmap, int *status)
+{
+	kbbuf buf;
+	vector<pair<strid_t, string> > strings;
+	string storedir;
+
+	if (!buf.open(filename))
+		return false;
 
-	{
-		boost::archive::text_iarchive ia(ifs);
-		ia >> public_dnodemap;
+	kbtextreader tr(buf.data(), buf.size());
+
+	if (!tr.read(dnmap) ||
+	    (tr.has_ids() && !tr.read(strings)) ||
+	    (kb_has_typerefs(dnmap) && !tr.read(storedir))) {
+		dnmap.clear();
+		return false;
 	}
-	ifs.close();
+
+	if (tr.has_ids())
+		put_strings(dnmap, strings);
+
+	*status = kb_has_typerefs(dnmap) ? kb_resolve_types(dnmap, storedir) : 0;
+	return true;
 }
 
 int kb_read_dnodemap(string filename, dnodemap& dnmap)
 {
-	ifstream ifs(filename.c_str());
-	if (!ifs.is_open()) {
+	int status;
+
+	if (kb_is_binmap(filename))
+		return kb_read_binmap(filename, dnmap);
+
+	if (read_textmap(filename, dnmap, &status))
+		return status;
+
+	// Compressed archives are decompressed as they are read.
+	boost::iostreams::filtering_istream in;
+	if (!kb_open_istream(filename, in)) {
 		cout << "Cannot open file: " << filename << endl;
 		return(-1);
 	}
 
-	{
-		boost::archive::text_iarchive ia(ifs);
-		ia >> dnmap;
-	}
-	ifs.close();
-	return 0;
+	return kb_load_dnodemap(in, dnmap);
 }
 
 #include <boost/format.hpp>
 using boost::format;
 
 
-void static inline dump_cnmap(cnodemap& cnmap, const char* field)
+void static inline dump_cnmap(ostream& os, cnodemap& cnmap, const char* field)
 {
 	if (cnmap.size() == 0)
 		return;
 
-	cout << format("\n\t%s: %3d\n") % field % cnmap.size();
+	os << format("\n\t%s: %3d\n") % field % cnmap.size();
 
 	// func arg level order flags par_order par_crc sib_order sib_crc name
-	for (auto i : cnmap) {
+	for (auto& i : cnmap) {
 		int order = i.first;
 		cnode& cn = i.second;
 
-		cout << format("\t%12lu %12lu %3d %5d %04X %5d %12lu %5d %12lu ")
+		os << format("\t%12lu %12lu %3d %5d %04X %5d %12lu %5d %12lu ")
 			% cn.function % cn.argument
 			% cn.level % order % cn.flags
 			% cn.parent.first % cn.parent.second
 			% cn.sibling.first % cn.sibling.second;
 		if (cn.flags & CTL_POINTER)
-			cout << "*";
-		if (cn.name.size() > 0)
-			cout << cn.name;
+			os << "*";
+		if (kb_str(cn.name).size() > 0)
+			os << kb_str(cn.name);
 		if (cn.flags & CTL_FILE)
-			cout << " : FILE";
+			os << " : FILE";
 		if (cn.flags & CTL_EXPORTED)
-			cout << " : EXPORTED";
+			os << " : EXPORTED";
+		if (cn.file)
+			os << " : file " << cn.file;
 
-		cout << endl;
+		os << endl;
 	}
 }
 
-void static inline dump_children(dnpair dnp)
+/******************************************************************************
+ * dump_children(ostream& os, dnodemap& dnmap, dnpair& dnp)
+ *
+ * The child dnodes and their cnodes are looked up with find(), so that
+ * dumping a graph never adds to it. A child that is not in the graph is
+ * shown as missing.
+ */
+void static inline dump_children(ostream& os, dnodemap& dnmap, dnpair& dnp)
 {
-	crcnodemap crcmap = dnp.second.children;
-	cout << format("\n\tchildren: %3d\n") %crcmap.size();
+	crcnodemap& crcmap = dnp.second.children;
+	os << format("\n\tchildren: %3d\n") %crcmap.size();
 
 	if (crcmap.size() == 0)
 		return;
 
-	for (auto i : crcmap) {
+	for (auto& i : crcmap) {
 		int order = i.first;
 		crc_t crc = i.second;
-		dnpair* dnp_p = lookup_dnode(crc);
-		dnode dn = dnp_p->second;
-		cnodemap siblings = dn.siblings;
-		cnode cn = siblings[order];
+		auto dnit = dnmap.find(crc);
+
+		if (dnit == dnmap.end()) {
+			os << format("\t%12lu %5d <missing dnode>\n")
+				% crc % order;
+			continue;
+		}
+
+		dnode& dn = dnit->second;
+		auto cnit = dn.siblings.find(order);
 
-		cout << format("\t%12lu %5d %s ")
-			% crc % i.first % dnp_p->second.decl;
+		os << format("\t%12lu %5d %s ")
+			% crc % order % kb_str(dn.decl);
+
+		if (cnit == dn.siblings.end()) {
+			os << "<missing cnode>" << endl;
+			continue;
+		}
+
+		cnode& cn = cnit->second;
 
 		if (cn.flags & CTL_POINTER)
-			cout << "*";
-		if (cn.name.size() > 0)
-			cout << cn.name;
+			os << "*";
+		if (kb_str(cn.name).size() > 0)
+			os << kb_str(cn.name);
 
 		if (cn.flags & CTL_FILE)
-			cout << " : FILE";
+			os << " : FILE";
 
-		cout << endl;
+		os << endl;
 	}
 }
 
-int kb_dump_dnodemap(char *filename)
+/******************************************************************************
+ * kb_dump_dnodemap(ostream& os, dnodemap& dnmap)
+ *
+ * The human readable view of a graph, which is the same whatever format the
+ * graph was read from. kabi-convert compares these to verify a conversion,
+ * so every field of every node is in it. The file of a cnode and the type
+ * digest of a dnode are only shown when they are set.
+ */
+void kb_dump_dnodemap(ostream& os, dnodemap& dnmap)
 {
-	dnodemap& dnmap = public_dnodemap;
+	os << "map size: " << dnmap.size() << endl;
 
-	if (int retval = kb_read_dnodemap(string(filename), dnmap) != 0)
-		return retval;
+	for (auto& it : dnmap) {
+		crc_t  crc = it.first;
+		dnode& dn  = it.second;
 
-	cout << "map size: " << dnmap.size() << endl;
+		os << format("%12lu %s ") % crc % kb_str(dn.decl);
 
-	for (auto it : dnmap) {
-		dnpair dnp = it;
-		crc_t  crc = dnp.first;
-		dnode& dn  = dnp.second;
+		if (dn.typedigest)
+			os << format(": typedigest %016lx ") % dn.typedigest;
 
-		cout << format("%12lu %s ") % crc % dn.decl;
-		dump_cnmap(dn.siblings, "siblings");
-		dump_children(dnp);
-		cout << endl;
+		dump_cnmap(os, dn.siblings, "siblings");
+		dump_children(os, dnmap, it);
+		os << endl;
 	}
+}
+
+int kb_dump_dnodemap(char *filename)
+{
+	dnodemap& dnmap = parsectx->dnmap;
+
+	if (int retval = kb_read_dnodemap(string(filename), dnmap) != 0)
+		return retval;
+
+	kb_dump_dnodemap(cout, dnmap);
 	return 0;
 }
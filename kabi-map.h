@@ -55,6 +55,9 @@ enum skdir {
 
 typedef unsigned long crc_t;
 
+// The graph of one translation unit, see kbparsectx below.
+struct kbparsectx;
+
 // This struct is created to pass information from the sparse environment to
 // the database environment. It is not serialized.
 struct sparm
@@ -74,10 +77,92 @@ struct sparm
 
 #ifdef __cplusplus
 
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <stdint.h>
+#include <unordered_map>
+#include <boost/serialization/version.hpp>
+
 // Forward declarations
 class dnode;
 class cnode;
 
+typedef uint32_t strid_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// strtab interns the decl and name strings of the graph. The same text,
+// e.g. "int" or "struct list_head", is shared by a great many dnodes and
+// cnodes, so each distinct string is kept here once and the nodes hold its
+// id. Id 0 is the empty string. Strings are never removed, so an id and the
+// string it refers to stay valid for the life of the kbparsectx that holds
+// the table, which is the life of the program for the public one.
+//
+class strtab
+{
+public:
+	strtab();
+
+	strid_t intern(const std::string& str);
+	const std::string& str(strid_t id) const { return m_strings[id]; }
+	size_t size() const { return m_strings.size(); }
+
+	// Set when an archive with string ids, rather than strings, has
+	// been loaded. See kb_read_dnodemap().
+	bool loaded_ids = false;
+
+private:
+	struct strhash {
+		size_t operator()(const std::string *str) const
+		{
+			return std::hash<std::string>()(*str);
+		}
+	};
+
+	struct strequal {
+		bool operator()(const std::string *lhs,
+				const std::string *rhs) const
+		{
+			return *lhs == *rhs;
+		}
+	};
+
+	std::deque<std::string> m_strings;	// deque keeps them in place
+	std::unordered_map<const std::string*, strid_t,
+			   strhash, strequal> m_index;
+};
+
+extern strtab& kb_get_strtab();
+
+static inline const std::string& kb_str(strid_t id)
+{
+	return kb_get_strtab().str(id);
+}
+
+static inline strid_t kb_intern(const std::string& str)
+{
+	return kb_get_strtab().intern(str);
+}
+
+// Archives written before the string table hold the strings themselves,
+// which are interned as they are loaded. Newer archives hold the ids, and
+// the strings follow the dnodemap. See kb_read_dnodemap().
+template<class Archive>
+void kb_serialize_str(Archive &ar, strid_t& id, bool isid)
+{
+	if (isid) {
+		ar & id;
+		if (Archive::is_loading::value)
+			kb_get_strtab().loaded_ids = true;
+		return;
+	}
+
+	std::string str;
+	ar & str;
+	id = kb_intern(str);
+}
+
 /*
  * The diagram below shows the layout of the graph comprised of dnodes
  * and cnodes.
@@ -156,7 +241,7 @@ class cnode
 public:
 	cnode(){}
 	cnode(crc_t func, crc_t arg, int level, int order,
-	      ctlflags flags, std::string name)
+	      ctlflags flags, strid_t name)
 		: function(func), argument(arg), level(level), order(order),
 		  flags(flags), name(name) {}
 
@@ -201,7 +286,7 @@ public:
 	int order;
 
 	enum ctlflags flags;
-	std::string name;
+	strid_t name = 0;	// id in the strtab
 
 	// These fields point back to the parent and sibling dnodes.
 	// Pairs made of the order in which the dnode was found and the
@@ -209,6 +294,12 @@ public:
 	std::pair<int, crc_t> parent;	// My parent dnode, by way of crc
 	std::pair<int, crc_t> sibling;  // My sibling dnode, by way of crc
 
+	// crc of the file at the top of this cnode's hierarchy. This
+	// identifies the originating file once the graphs of many files
+	// have been merged by kabi-merge. Graphs written before version 1
+	// of the cnode class have zero here.
+	crc_t file = 0;
+
 	void operator =(const cnode& cn);
 	bool operator ==(const cnode& cn) const;
 
@@ -216,14 +307,19 @@ public:
 	template<class Archive>
         void serialize(Archive &ar, const unsigned int version)
         {
-		if (version){;}
-		ar & function & argument &level & order & flags & name
-		   & parent & sibling;
+		ar & function & argument &level & order & flags;
+		kb_serialize_str(ar, name, version > 1);
+		ar & parent & sibling;
+
+		if (version > 0)
+			ar & file;
 	}
 
 private:
 };
 
+BOOST_CLASS_VERSION(cnode, 2)
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // dnode is a descriptor of a declaration of any data type encountered by
@@ -254,15 +350,20 @@ class dnode {
 
 public:
 	dnode(){}		// constructor
-	dnode(std::string decl) : decl(decl) {}
+	dnode(strid_t decl) : decl(decl) {}
 
 	void insert(dnodemap&, dnpair);
 	void insert(dnodemap&, dnpair_p);
 
-	std::string decl;	// data type declaration
+	strid_t decl = 0;	// data type declaration, id in the strtab
 	cnodemap siblings;
 	crcnodemap children;
 
+	// If not zero, the descendants of the first instance of this dnode
+	// were moved to the type store, under the crc and this digest. They
+	// are put back when the graph is read. See kabi-store.h
+	uint64_t typedigest = 0;
+
 	void operator =(const dnode& dn);
 	bool operator ==(const dnode& dn) const;
 
@@ -270,11 +371,16 @@ public:
 	template<class Archive>
         void serialize(Archive &ar, const unsigned int version)
         {
-		if (version){;}
-		ar & decl & siblings & children;
+		kb_serialize_str(ar, decl, version > 0);
+		ar & siblings & children;
+
+		if (version > 1)
+			ar & typedigest;
 	}
 };
 
+BOOST_CLASS_VERSION(dnode, 2)
+
 // This class serves as a wrapper for the hash map of qnodes.
 // Having a class wrapper allows us to add other controls
 // easily if needed in the future.
@@ -293,6 +399,26 @@ public:
 	}
 };
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbparsectx holds everything built from one translation unit: its graph,
+// the strings of the graph, the order counter of its cnodes, and the
+// sparms and nodes allocated on the way. The functions below work on the
+// current context. That is the public one, which the lookup tools use,
+// unless kabi-parser has set another with kb_set_parsectx(). Freeing a
+// context frees all of it, so a parser that handles many files one after
+// another only holds the graph of the current one.
+//
+struct kbparsectx
+{
+	dnodemap dnmap;
+	strtab strings;
+	int order = 0;
+	std::deque<sparm> sparms;
+	std::deque<dnode> dnodes;
+	std::deque<cnode> cnodes;
+};
+
 /*****************************************
 ** Function Prototypes
 *****************************************/
@@ -300,12 +426,21 @@ public:
 extern dnodemap& kb_get_public_dnodemap();
 extern int kb_read_dnodemap(std::string filename, dnodemap& dnmap);
 extern dnode* kb_lookup_dnode(crc_t crc);
-extern bool kb_is_adjacent(cnode& ref, cnode &dyn, skdir step);
+extern int kb_merge_dnodemap(dnodemap& dst, dnodemap& src, int base);
+extern void kb_write_dnodemap_other(std::string& filename, dnodemap& dnmap);
+extern void kb_save_dnodemap(std::ostream& os, dnodemap& dnmap);
+extern int kb_load_dnodemap(std::istream& is, dnodemap& dnmap);
+extern std::string kb_get_typestore(dnodemap& dnmap);
+extern void kb_dump_dnodemap(std::ostream& os, dnodemap& dnmap);
+extern bool kb_is_adjacent(const cnode& ref, const cnode &dyn, skdir step);
 
 extern "C"
 {
 #endif
 
+extern struct kbparsectx *kb_new_parsectx(void);
+extern void kb_set_parsectx(struct kbparsectx *ctx);
+extern void kb_free_parsectx(struct kbparsectx *ctx);
 extern struct sparm *kb_new_sparm(struct sparm *parent, enum ctlflags flags);
 extern struct sparm *kb_new_firstsparm(char *file);
 extern void kb_init_crc(const char *string, struct sparm *sp, struct sparm *parent);
@@ -317,6 +452,9 @@ extern const char *kb_get_decl(struct sparm *qn);
 extern bool kb_is_dup(struct sparm *sp);
 extern const char *kb_cstrcat(const char *d, const char *s);
 extern void kb_write_dnodemap(const char *filename);
+extern void kb_set_binmap(bool enable);
+extern void kb_set_zstdmap(bool enable);
+extern void kb_set_typestore(const char *storedir);
 extern void kb_restore_dnodemap(char *filename);
 extern int kb_dump_dnodemap(char *filename);
 
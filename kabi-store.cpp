@@ -0,0 +1,446 @@
+/* kabi-store.cpp - store of the types shared by the graphs of a kernel tree
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "kabi-store.h"
+
+using namespace std;
+
+typedef pair<crc_t, uint64_t> typekey;
+typedef map<int, crc_t> ordermap;	// order -> crc of the dnode that has it
+
+// Expansions already read from the store. A lookup reads the same few
+// types for thousands of files. See get_type() for its size.
+static map<typekey, dnodemap> typecache;
+static size_t typecache_cnodes;
+
+/***********************************
+**  Static functions
+***********************************/
+
+static string get_typefile(const string& storedir, crc_t crc, uint64_t digest)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "/%lu-%016llx" KB_STORE_EXT,
+		 crc, (unsigned long long)digest);
+	return storedir + name;
+}
+
+// 64 bit FNV-1a
+static inline void hash_bytes(uint64_t& hash, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+}
+
+static inline void hash_val(uint64_t& hash, uint64_t val)
+{
+	hash_bytes(hash, &val, sizeof(val));
+}
+
+static inline void hash_str(uint64_t& hash, strid_t id)
+{
+	const string& str = kb_str(id);
+	hash_bytes(hash, str.c_str(), str.size() + 1);
+}
+
+/******************************************************************************
+ * get_digest(crc_t crc, dnodemap& exp)
+ *
+ * Hash the relative expansion of the type. Strings are hashed by content,
+ * because their ids are only good within one program.
+ */
+static uint64_t get_digest(crc_t crc, dnodemap& exp)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	hash_val(hash, crc);
+
+	for (auto& it : exp) {
+		dnode& dn = it.second;
+
+		hash_val(hash, it.first);
+		hash_str(hash, dn.decl);
+		hash_val(hash, dn.siblings.size());
+
+		for (auto& cnit : dn.siblings) {
+			cnode& cn = cnit.second;
+
+			hash_val(hash, cnit.first);
+			hash_val(hash, cn.level);
+			hash_val(hash, cn.flags);
+			hash_str(hash, cn.name);
+			hash_val(hash, cn.parent.first);
+			hash_val(hash, cn.parent.second);
+		}
+
+		hash_val(hash, dn.children.size());
+
+		for (auto& crcit : dn.children) {
+			hash_val(hash, crcit.first);
+			hash_val(hash, crcit.second);
+		}
+	}
+
+	return hash;
+}
+
+/******************************************************************************
+ * get_extent(dnodemap& dnmap, dnode& dn, int last)
+ *
+ * Returns the order of the last descendant of the first instance of dn.
+ * Only the first instance of a dnode has its children expanded.
+ */
+static int get_extent(dnodemap& dnmap, dnode& dn, int last)
+{
+	for (auto& it : dn.children) {
+		dniterator dnit = dnmap.find(it.second);
+
+		last = max(last, it.first);
+
+		if (dnit == dnmap.end())
+			continue;
+
+		dnode& cdn = dnit->second;
+
+		if (!cdn.siblings.empty() && (cdn.siblings.begin()->first == it.first))
+			last = get_extent(dnmap, cdn, last);
+	}
+
+	return last;
+}
+
+/******************************************************************************
+ * get_expansion(dnodemap& dnmap, ordermap& cnodes, ordermap& kids,
+ *		 crc_t crc, int last, dnodemap& exp)
+ *
+ * Copy the expansion of the type into exp, relative to its first instance.
+ * Returns false if any part of it does not follow the rules in kabi-store.h,
+ * in which case the type is left in the graph.
+ */
+static bool get_expansion(dnodemap& dnmap, ordermap& cnodes, ordermap& kids,
+			  crc_t crc, int last, dnodemap& exp)
+{
+	dnode& tdn = dnmap[crc];
+	const cnode& top = tdn.siblings.begin()->second;
+	int base = tdn.siblings.begin()->first;
+
+	for (auto it = cnodes.upper_bound(base);
+	     (it != cnodes.end()) && (it->first <= last); ++it) {
+		dnode& dn = dnmap[it->second];
+		cnode cn = dn.siblings[it->first];
+
+		if ((cn.function != top.function) ||
+		    (cn.argument != top.argument) ||
+		    (cn.file != top.file) ||
+		    (cn.level <= top.level) ||
+		    (cn.parent.first < base) || (cn.parent.first > last) ||
+		    (cn.sibling.first != dn.siblings.begin()->first) ||
+		    (cn.sibling.second != it->second))
+			return false;
+
+		cn.order -= base;
+		cn.level -= top.level;
+		cn.parent.first -= base;
+		cn.function = 0;
+		cn.argument = 0;
+		cn.file = 0;
+		cn.sibling = make_pair(0, 0);
+
+		dnode& edn = exp[it->second];
+		edn.decl = dn.decl;
+		edn.siblings.insert(edn.siblings.end(),
+				    make_pair(it->first - base, cn));
+	}
+
+	for (auto it = kids.upper_bound(base);
+	     (it != kids.end()) && (it->first <= last); ++it) {
+		dnode& dn = dnmap[it->second];
+		dnode& edn = exp[it->second];
+
+		edn.decl = dn.decl;
+		edn.children.insert(edn.children.end(),
+				    make_pair(it->first - base,
+					      dn.children[it->first]));
+	}
+
+	// A dnode that is left with no cnodes must go with all its children.
+	for (auto& it : exp) {
+		dnode& dn = dnmap[it.first];
+
+		if ((it.second.siblings.size() == dn.siblings.size()) &&
+		    (it.second.children.size() != dn.children.size()))
+			return false;
+	}
+
+	return true;
+}
+
+/******************************************************************************
+ * cut_expansion(dnodemap& dnmap, ordermap& cnodes, ordermap& kids,
+ *		 int base, int last)
+ *
+ * Remove the expansion that was stored from the graph.
+ */
+static void cut_expansion(dnodemap& dnmap, ordermap& cnodes, ordermap& kids,
+			  int base, int last)
+{
+	for (auto it = kids.upper_bound(base);
+	     (it != kids.end()) && (it->first <= last); ++it)
+		dnmap[it->second].children.erase(it->first);
+
+	for (auto it = cnodes.upper_bound(base);
+	     (it != cnodes.end()) && (it->first <= last); ++it) {
+		dniterator dnit = dnmap.find(it->second);
+
+		if (dnit == dnmap.end())
+			continue;
+
+		dnit->second.siblings.erase(it->first);
+
+		if (dnit->second.siblings.empty())
+			dnmap.erase(dnit);
+	}
+}
+
+static int put_type(const string& storedir, crc_t crc, uint64_t digest,
+		    dnodemap& exp)
+{
+	string typefile = get_typefile(storedir, crc, digest);
+	string tmpfile = typefile + "." + to_string(getpid());
+
+	// Another file already stored it.
+	if (access(typefile.c_str(), F_OK) == 0)
+		return 0;
+
+	ofstream ofs(tmpfile);
+
+	if (!ofs.is_open()) {
+		cout << "Cannot open file: " << tmpfile << endl;
+		return -1;
+	}
+
+	kb_save_dnodemap(ofs, exp);
+	ofs.close();
+
+	// Graphs of many files are made at the same time, so the entry only
+	// appears in the store once it is complete.
+	if (ofs.fail() || rename(tmpfile.c_str(), typefile.c_str())) {
+		cout << "Cannot write file: " << typefile << endl;
+		remove(tmpfile.c_str());
+		return -1;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * get_type(string& storedir, crc_t crc, uint64_t digest)
+ *
+ * Returns the expansion, from the cache if it has been read before. A long
+ * sweep or a kabi-lookup server would otherwise keep every expansion it
+ * ever read, so the cache is emptied once it holds KB_STORE_CACHEMAX
+ * cnodes. The types that are used everywhere are soon read back. The
+ * expansion returned is only good until the next call.
+ */
+static dnodemap *get_type(const string& storedir, crc_t crc, uint64_t digest)
+{
+	typekey key = make_pair(crc, digest);
+	auto it = typecache.find(key);
+
+	if (it != typecache.end())
+		return &it->second;
+
+	if (typecache_cnodes >= KB_STORE_CACHEMAX) {
+		typecache.clear();
+		typecache_cnodes = 0;
+	}
+
+	dnodemap& exp = typecache[key];
+
+	if (kb_read_dnodemap(get_typefile(storedir, crc, digest), exp) != 0) {
+		typecache.erase(key);
+		return NULL;
+	}
+
+	for (auto& dnit : exp)
+		typecache_cnodes += dnit.second.siblings.size();
+
+	return &exp;
+}
+
+/***********************************
+**  Global functions
+***********************************/
+
+/******************************************************************************
+ * kb_store_types(dnodemap& dnmap, string& storedir)
+ *
+ * Move the expansions of the compound types in the graph to the store, and
+ * leave their digests in their dnodes. Types are taken in the order of their
+ * first instance, so a type that is inside the expansion of another goes
+ * with it, rather than being stored on its own.
+ */
+int kb_store_types(dnodemap& dnmap, const string& storedir)
+{
+	ordermap cnodes;
+	ordermap kids;
+	vector<pair<int, crc_t> > types;
+	int end = 0;
+
+	if (mkdir(storedir.c_str(), 0755) && (errno != EEXIST)) {
+		cout << "Cannot create directory: " << storedir << endl;
+		return -1;
+	}
+
+	for (auto& it : dnmap) {
+		dnode& dn = it.second;
+
+		for (auto& cnit : dn.siblings)
+			cnodes[cnit.first] = it.first;
+
+		for (auto& crcit : dn.children)
+			kids[crcit.first] = it.first;
+
+		if (dn.siblings.empty() || dn.children.empty())
+			continue;
+
+		const cnode& cn = dn.siblings.begin()->second;
+
+		if ((cn.level < LVL_ARG) ||
+		    (cn.flags & (CTL_FILE | CTL_EXPORTED | CTL_FUNCTION)))
+			continue;
+
+		types.push_back(make_pair(dn.siblings.begin()->first, it.first));
+	}
+
+	sort(types.begin(), types.end());
+
+	for (auto& type : types) {
+		int base = type.first;
+		crc_t crc = type.second;
+		dnodemap exp;
+
+		if (base <= end)
+			continue;
+
+		int last = get_extent(dnmap, dnmap[crc], base);
+
+		if ((last - base < KB_STORE_MINSIZE) ||
+		    !get_expansion(dnmap, cnodes, kids, crc, last, exp))
+			continue;
+
+		uint64_t digest = get_digest(crc, exp);
+
+		if (put_type(storedir, crc, digest, exp) != 0)
+			return -1;
+
+		cut_expansion(dnmap, cnodes, kids, base, last);
+		dnmap[crc].typedigest = digest;
+		end = last;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * kb_resolve_types(dnodemap& dnmap, string& storedir)
+ *
+ * Put the expansions of the types back into a graph read from a file.
+ */
+int kb_resolve_types(dnodemap& dnmap, const string& storedir)
+{
+	vector<crc_t> types;
+	vector<pair<crc_t, int> > cnodes;
+
+	for (auto& it : dnmap)
+		if (it.second.typedigest)
+			types.push_back(it.first);
+
+	for (crc_t crc : types) {
+		dnode& tdn = dnmap[crc];
+		dnodemap *exp = get_type(storedir, crc, tdn.typedigest);
+
+		if (!exp)
+			return -1;
+
+		const cnode top = tdn.siblings.begin()->second;
+		int base = tdn.siblings.begin()->first;
+
+		for (auto& it : *exp) {
+			dnode& dn = dnmap[it.first];
+
+			dn.decl = it.second.decl;
+
+			for (auto& cnit : it.second.siblings) {
+				cnode cn = cnit.second;
+
+				cn.order += base;
+				cn.level += top.level;
+				cn.parent.first += base;
+				cn.function = top.function;
+				cn.argument = top.argument;
+				cn.file = top.file;
+				dn.siblings.insert(make_pair(cn.order, cn));
+				cnodes.push_back(make_pair(it.first, cn.order));
+			}
+
+			for (auto& crcit : it.second.children)
+				dn.children.insert(make_pair(crcit.first + base,
+							     crcit.second));
+		}
+
+		tdn.typedigest = 0;
+	}
+
+	// Each cnode points to the first instance of its dnode, which may
+	// have come from another expansion.
+	for (auto& it : cnodes) {
+		dnode& dn = dnmap[it.first];
+		dn.siblings[it.second].sibling =
+			make_pair(dn.siblings.begin()->first, it.first);
+	}
+
+	return 0;
+}
+
+bool kb_has_typerefs(dnodemap& dnmap)
+{
+	for (auto& it : dnmap)
+		if (it.second.typedigest)
+			return true;
+
+	return false;
+}
@@ -0,0 +1,60 @@
+/* kabi-store.h - store of the types shared by the graphs of a kernel tree
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef KABISTORE_H
+#define KABISTORE_H
+
+#include <string>
+#include "kabi-map.h"
+
+/*
+ * Common kernel types, like struct device, are expanded in the graph of
+ * nearly every file that uses them. The type store keeps each expansion
+ * once, in a directory shared by all the graphs of the kernel tree.
+ *
+ * The expansion of a type is everything kabi-parser found below the first
+ * instance of it in a file: the cnodes from the order after the instance
+ * to the order of its last descendant, and the children entries for those
+ * orders. Every one of those cnodes has the function, argument and file of
+ * the instance, so they are stored with their orders and levels relative
+ * to the instance, and those fields cleared. The sibling field is rebuilt
+ * from the dnode when the expansion is put back.
+ *
+ * An expansion is stored as a text archive in <store>/<crc>-<digest>.kbt,
+ * where digest is a hash of the relative expansion. Files that expand a
+ * type the same way share the same entry. The dnode of the instance keeps
+ * the digest in its typedigest field, and the graph keeps the path to the
+ * store, so the tools that read the graph can put the expansion back.
+ */
+
+#define KB_STORE_EXT		".kbt"
+#define KB_STORE_MINSIZE	8	// smallest expansion stored, in orders
+#define KB_STORE_CACHEMAX	(1 << 18) // cnodes of expansions kept read
+
+/*****************************************
+** Function Prototypes
+*****************************************/
+
+extern int kb_store_types(dnodemap& dnmap, const std::string& storedir);
+extern int kb_resolve_types(dnodemap& dnmap, const std::string& storedir);
+extern bool kb_has_typerefs(dnodemap& dnmap);
+
+#endif // KABISTORE_H
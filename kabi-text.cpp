@@ -0,0 +1,381 @@
+/* kabi-text.cpp - fast reader for the boost text archives of kabi graphs
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <cstring>
+
+#include "kabi-text.h"
+
+using namespace std;
+
+#define KBT_SIGNATURE	"serialization::archive"
+#define KBT_MAXDIGITS	20	// digits in the largest uint64_t
+
+// The item version of collections was added in this library version.
+#define KBT_ITEMVERSION	3
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define KBT_SWAR
+#endif
+
+/***********************************
+**  Static functions
+***********************************/
+
+static inline bool is_space(char c)
+{
+	return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t');
+}
+
+static inline bool is_digit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+#ifdef KBT_SWAR
+
+/******************************************************************************
+ * get_8digits(uint64_t x)
+ *
+ * x holds the values of 8 decimal digits, one per byte, the most significant
+ * in the lowest byte, as they are loaded from the text on a little endian
+ * machine. Returns their value, combining pairs of digits, then pairs of
+ * those, then pairs of those.
+ */
+static inline uint32_t get_8digits(uint64_t x)
+{
+	x = (x * 10) + (x >> 8);
+	x = (((x & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+	     (((x >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+	return (uint32_t)x;
+}
+
+/******************************************************************************
+ * count_digits(uint64_t x)
+ *
+ * x holds 8 characters with '0' xored out of each byte. Returns how many of
+ * them, from the lowest byte, were digits. A byte was a digit if it is now
+ * less than 10, which shows in its high bit after adding 0x76. The high bit
+ * is masked off before the add, so no byte carries into the next.
+ */
+static inline unsigned count_digits(uint64_t x)
+{
+	uint64_t nondigits;
+
+	nondigits = (((x & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL) | x)
+		    & 0x8080808080808080ULL;
+
+	return nondigits ? __builtin_ctzll(nondigits) / 8 : 8;
+}
+
+static const uint32_t pow10[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+#endif // KBT_SWAR
+
+/***********************************
+**  kbtextreader
+***********************************/
+
+/******************************************************************************
+ * kbtextreader::get_uint(uint64_t& val)
+ *
+ * Most of the archive is numbers, so this is where the time goes. Up to 8
+ * digits are converted at once where the machine allows.
+ */
+bool kbtextreader::get_uint(uint64_t& val)
+{
+	unsigned ndigits = 0;
+
+	while ((m_pos < m_end) && is_space(*m_pos))
+		++m_pos;
+
+	val = 0;
+
+#ifdef KBT_SWAR
+	while (m_end - m_pos >= 8) {
+		uint64_t x;
+		unsigned count;
+
+		memcpy(&x, m_pos, sizeof(x));
+		x ^= 0x3030303030303030ULL;
+		count = count_digits(x);
+
+		if (!count)
+			break;
+
+		// Shift the digits to the top, leaving zeros in front.
+		val = val * pow10[count] + get_8digits(x << (8 * (8 - count)));
+		m_pos += count;
+		ndigits += count;
+
+		if (count < 8)
+			return ndigits <= KBT_MAXDIGITS;
+	}
+#endif
+
+	while ((m_pos < m_end) && is_digit(*m_pos)) {
+		val = val * 10 + (*m_pos++ - '0');
+		++ndigits;
+	}
+
+	return (ndigits > 0) && (ndigits <= KBT_MAXDIGITS);
+}
+
+bool kbtextreader::get_int(int64_t& val)
+{
+	uint64_t v;
+	bool negative = false;
+
+	while ((m_pos < m_end) && is_space(*m_pos))
+		++m_pos;
+
+	if ((m_pos < m_end) && (*m_pos == '-')) {
+		negative = true;
+		++m_pos;
+	}
+
+	if (!get_uint(v))
+		return false;
+
+	val = negative ? -(int64_t)v : (int64_t)v;
+	return true;
+}
+
+/******************************************************************************
+ * kbtextreader::get_str(const char **str, size_t *len)
+ *
+ * A string is its length, one space, and exactly that many characters,
+ * which may include spaces.
+ */
+bool kbtextreader::get_str(const char **str, size_t *len)
+{
+	uint64_t size;
+
+	if (!get_uint(size) || (m_pos >= m_end) || (*m_pos != ' '))
+		return false;
+
+	++m_pos;
+
+	if (size > (uint64_t)(m_end - m_pos))
+		return false;
+
+	*str = m_pos;
+	*len = size;
+	m_pos += size;
+	return true;
+}
+
+bool kbtextreader::get_strid(strid_t& id, bool isid)
+{
+	const char *str;
+	size_t len;
+
+	if (isid) {
+		m_hasids = true;
+		return get(id);
+	}
+
+	if (!get_str(&str, &len))
+		return false;
+
+	m_str.assign(str, len);
+	id = kb_intern(m_str);
+	return true;
+}
+
+bool kbtextreader::get_header()
+{
+	const char *str;
+	size_t len;
+
+	return get_str(&str, &len) &&
+	       (len == strlen(KBT_SIGNATURE)) &&
+	       !memcmp(str, KBT_SIGNATURE, len) &&
+	       get_uint(m_libver);
+}
+
+/******************************************************************************
+ * kbtextreader::get_class(kbtclass cls)
+ *
+ * Read the tracking level and version of the class if this is its first
+ * object. Tracked objects are preceded by ids, which this reader doesn't
+ * expect, so it gives up on them.
+ */
+bool kbtextreader::get_class(kbtclass cls)
+{
+	uint64_t tracking;
+	uint64_t version;
+
+	if (m_seen[cls])
+		return true;
+
+	if (!get_uint(tracking) || tracking || !get_uint(version))
+		return false;
+
+	m_seen[cls] = true;
+	m_version[cls] = version;
+	return true;
+}
+
+bool kbtextreader::get_count(size_t& count)
+{
+	uint64_t itemversion;
+
+	if (!get(count))
+		return false;
+
+	// Every item takes at least two characters, so a bad count is caught
+	// before anything is reserved for it.
+	if (count > (size_t)(m_end - m_pos) / 2)
+		return false;
+
+	return (m_libver <= KBT_ITEMVERSION) || get_uint(itemversion);
+}
+
+bool kbtextreader::get_cnode(cnode& cn)
+{
+	uint32_t version = m_version[KBT_CNODE];
+	int64_t level, order, flags, parent, sibling;
+
+	if (!get(cn.function) || !get(cn.argument) ||
+	    !get_int(level) || !get_int(order) || !get_int(flags) ||
+	    !get_strid(cn.name, version > 1) ||
+	    !get_class(KBT_CRCLINK) ||
+	    !get_int(parent) || !get(cn.parent.second) ||
+	    !get_int(sibling) || !get(cn.sibling.second) ||
+	    ((version > 0) && !get(cn.file)))
+		return false;
+
+	cn.level = level;
+	cn.order = order;
+	cn.flags = (ctlflags)flags;
+	cn.parent.first = parent;
+	cn.sibling.first = sibling;
+	return true;
+}
+
+bool kbtextreader::get_dnode(dnode& dn)
+{
+	size_t count;
+	int64_t order;
+
+	if (!get_class(KBT_DNODE) ||
+	    !get_strid(dn.decl, m_version[KBT_DNODE] > 0))
+		return false;
+
+	if (!get_class(KBT_CNODEMAP) || !get_count(count))
+		return false;
+
+	// The maps were written in order, so every insert is at the end.
+	for (size_t i = 0; i < count; ++i) {
+		if (!get_class(KBT_CNPAIR) || !get_int(order) ||
+		    !get_class(KBT_CNODE))
+			return false;
+
+		cniterator cnit = dn.siblings.insert(dn.siblings.end(),
+						     make_pair(order, cnode()));
+
+		if (!get_cnode(cnit->second))
+			return false;
+	}
+
+	if (!get_class(KBT_CRCNODEMAP) || !get_count(count))
+		return false;
+
+	for (size_t i = 0; i < count; ++i) {
+		crc_t crc;
+
+		if (!get_class(KBT_CRCPAIR) || !get_int(order) || !get(crc))
+			return false;
+
+		dn.children.insert(dn.children.end(), make_pair(order, crc));
+	}
+
+	return (m_version[KBT_DNODE] < 2) || get(dn.typedigest);
+}
+
+/******************************************************************************
+ * kbtextreader::read(dnodemap& dnmap)
+ *
+ * Read the archive header and the dnodemap. Returns false if the archive
+ * does not have the layout in kabi-text.h.
+ */
+bool kbtextreader::read(dnodemap& dnmap)
+{
+	size_t count;
+
+	dnmap.clear();
+
+	if (!get_header() || !get_class(KBT_DNODEMAP) || !get_count(count))
+		return false;
+
+	for (size_t i = 0; i < count; ++i) {
+		crc_t crc;
+
+		if (!get_class(KBT_DNPAIR) || !get(crc))
+			return false;
+
+		dniterator dnit = dnmap.insert(dnmap.end(),
+					       make_pair(crc, dnode()));
+
+		if (!get_dnode(dnit->second))
+			return false;
+	}
+
+	return true;
+}
+
+bool kbtextreader::read(vector<pair<strid_t, string> >& strings)
+{
+	size_t count;
+
+	if (!get_class(KBT_STRINGS) || !get_count(count))
+		return false;
+
+	strings.reserve(count);
+
+	for (size_t i = 0; i < count; ++i) {
+		strid_t id;
+		const char *str;
+		size_t len;
+
+		if (!get_class(KBT_STRPAIR) || !get(id) || !get_str(&str, &len))
+			return false;
+
+		strings.push_back(make_pair(id, string(str, len)));
+	}
+
+	return true;
+}
+
+bool kbtextreader::read(string& str)
+{
+	const char *s;
+	size_t len;
+
+	if (!get_str(&s, &len))
+		return false;
+
+	str.assign(s, len);
+	return true;
+}
@@ -0,0 +1,123 @@
+/* kabi-text.h - fast reader for the boost text archives of kabi graphs
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef KABITEXT_H
+#define KABITEXT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "kabi-map.h"
+
+/*
+ * Graphs that were written as boost text archives, which includes every
+ * graph written before the binary format, can be parsed without boost.
+ * The archive is a stream of decimal numbers separated by spaces, and of
+ * strings written as their length, a space, and the characters. For the
+ * archives written by kb_save_dnodemap() and older versions of it, that is
+ *
+ *   22 serialization::archive <library version>
+ *   dnodemap  : [class] count item_version pair ...
+ *   pair      : [class] crc dnode
+ *   dnode     : [class] decl siblings children [typedigest]
+ *   siblings  : [class] count item_version { [class] order cnode } ...
+ *   cnode     : [class] function argument level order flags name
+ *               parent sibling [file]
+ *   parent,
+ *   sibling   : [class] order crc
+ *   children  : [class] count item_version { [class] order crc } ...
+ *
+ * followed by the strings and the path of the type store, if the archive
+ * has them, see kb_load_dnodemap(). [class] is the tracking level and the
+ * version of a class, which only precede the first object of that class in
+ * the archive. The versions of dnode and cnode tell which of the optional
+ * fields are present, and whether decl and name are strings or ids.
+ *
+ * kbtextreader parses this layout straight from memory. Anything else,
+ * like an archive with object tracking, is left for boost to read.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// kbtextreader reads a text archive from a buffer, usually a kbbuf.
+//
+class kbtextreader
+{
+public:
+	kbtextreader(const char *data, size_t size)
+		: m_pos(data), m_end(data + size) {}
+
+	bool read(dnodemap& dnmap);
+	bool read(std::vector<std::pair<strid_t, std::string> >& strings);
+	bool read(std::string& str);
+
+	// True if decl and name were read as ids, so the strings follow
+	// the dnodemap.
+	bool has_ids() const { return m_hasids; }
+
+private:
+	enum kbtclass {
+		KBT_DNODEMAP,
+		KBT_DNPAIR,
+		KBT_DNODE,
+		KBT_CNODEMAP,
+		KBT_CNPAIR,
+		KBT_CNODE,
+		KBT_CRCLINK,	// cnode::parent and cnode::sibling
+		KBT_CRCNODEMAP,
+		KBT_CRCPAIR,
+		KBT_STRINGS,
+		KBT_STRPAIR,
+		KBT_COUNT
+	};
+
+	bool get_header();
+	bool get_class(kbtclass cls);
+	bool get_count(size_t& count);
+	bool get_uint(uint64_t& val);
+	bool get_int(int64_t& val);
+	bool get_str(const char **str, size_t *len);
+	bool get_strid(strid_t& id, bool isid);
+	bool get_cnode(cnode& cn);
+	bool get_dnode(dnode& dn);
+
+	template <typename T>
+	bool get(T& val)
+	{
+		uint64_t v;
+
+		if (!get_uint(v))
+			return false;
+
+		val = (T)v;
+		return true;
+	}
+
+	const char *m_pos;
+	const char *m_end;
+	uint64_t m_libver = 0;
+	bool m_seen[KBT_COUNT] = {};
+	uint32_t m_version[KBT_COUNT] = {};
+	bool m_hasids = false;
+	std::string m_str;	// reused for every string that is interned
+};
+
+#endif // KABITEXT_H
@@ -51,11 +51,17 @@
  * 	declared.
  */
 
+#define _GNU_SOURCE		// for memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <sparse/symbol.h>
 
 #include "kabi.h"
@@ -87,10 +93,12 @@ do { \
 static const char *helptext ="\
 \n\
 kabi-parser [options] -f filespec \n\
+kabi-parser [options] -j jobs -l listfile \n\
 \n\
     Parses \".i\" (intermediate, c-preprocessed) files for exported \n\
     symbols and symbols of structs and unions that are used by the \n\
-    exported symbols. \n\
+    exported symbols. A file with no sign of an export in its text is \n\
+    not parsed, and gets no graph. \n\
 \n\
 Command line arguments:\n\
     -f filespec - Required. Specification of .i files to be processed.\n\
@@ -98,11 +106,27 @@ Command line arguments:\n\
     -o outfile  - Optional. Filename for output data file. \n\
                   The default is \"../kabi-data.dat\". \n\
     -x    Optional. Delete the data file before starting. \n\
+    -b    Optional. Write the graph in the binary format, which \n\
+          kabi-lookup can search without deserializing it. \n\
+    -z    Optional. Compress the graph with zstd. The usual name for\n\
+          a compressed graph is foo.kbg.zst\n\
+    -t storedir - Optional. Move the expansions of the data types to the\n\
+                  type store in storedir, which is shared by all the\n\
+                  graphs of the kernel tree, and leave a reference to\n\
+                  them in the graph.\n\
     -p    Optional. Parser environment, \"tab\" or \"gen\". \n\
           Default is \"tab\", or normal kernel build.\n\
           \"gen\" is for kernels built with __GENKSYMS__ defined.\n\
     -r    Optional. Report status. Minor problems can interrupt a build.\n\
     -S    Optional. Command line arguments for the sparse semantic parser.\n\
+    -l listfile - Parse each .i file named in listfile, one per line, or \n\
+                  on stdin if it is -, into a graph of its own, named \n\
+                  like foo.kbg for foo.i, or foo.kbg.zst with -z. The \n\
+                  name of each graph is printed on stdout when it has \n\
+                  been written. -o, -x and -c do not apply. \n\
+    -j jobs     - Optional with -l. Parse the files with this many \n\
+                  processes, each started once for many files. The \n\
+                  default is one. \n\
     -h    This help message.\n\
 \n\
 Example: \n\
@@ -125,25 +149,38 @@ enum pfxindex {
 struct pfxentry {
 	const char *key;
 	const char *pfx;
+	const char *scan;	// in the text of any file that exports a symbol
 }
-pfxtab[] = {	{"tab", "__ksymtab_"},
-		{"gen", "EXPORT_"},
+pfxtab[] = {	{"tab", "__ksymtab_", "__ksymtab_"},
+		{"gen", "EXPORT_", "EXPORT"},
 };
 
 static enum pfxindex pfxidx = PFX_KSYMTAB;
 static const char *ksymprefix;
 static bool kp_rmfiles = false;
 static bool cumulative = false;
-static struct symbol_list *symlist = NULL;
-static bool kabiflag = false;
 static char *datafilename = "../kabi-data.dat";
 static char *infilespec;
-static FILE *inputfile;
+static char *listfilename;
+static const char *graphext = ".kbg";
+static int jobs = 1;
 static char *sparseargv[MAX_SPARSE_ARGS];
 static char **spargvp = &sparseargv[0];
 static int sparseargc = 1;
 static bool report = false;
 
+/*
+ * The translation unit being parsed. Everything the parser keeps about a
+ * file is here, or in the kbparsectx of its graph, so that one process can
+ * parse many files, one after another.
+ */
+struct kbunit {
+	char *file;			// the .i file
+	struct symbol_list *symlist;	// its symbols, from sparse
+	FILE *inputfile;		// the file, read again for PFX_GENKSYM
+	bool exported;			// it has at least one exported symbol
+};
+
 /*****************************************************
 ** sparse wrappers
 ******************************************************/
@@ -184,7 +221,7 @@ static char *pad_out(int padsize, char padchar)
 //----------------------------------------------------
 // Forward Declarations
 //----------------------------------------------------
-static bool is_exported(struct symbol *sym);
+static bool is_exported(struct kbunit *tu, struct symbol *sym);
 static void get_declist(struct sparm *sp, struct symbol *sym);
 static struct symbol *find_internal_exported (struct symbol_list *symlist,
 					      char *symname);
@@ -335,7 +372,6 @@ static void build_branch(struct symbol *sym, struct sparm *parent)
 		printf("symbolname: %s\n", symname);
 #endif
 	sp->name = sym->ident->name;
-	kabiflag = true;
 	get_declist(sp, sym);
 
 	// If this is an exported struct or union, we need the decl
@@ -410,7 +446,7 @@ static struct symbol *find_internal_exported (struct symbol_list *symlist,
 
 /******************************************************************************
  * PFX_KSYMTAB:
- * process_symname(symbol *sym, sparm *parent)
+ * process_symname(kbunit *tu, symbol *sym, sparm *parent)
  *
  * For __ksymtab_ processing, exported symbols are identified by the leading
  * "__ksymtab_" string. However, these symbols are the results of the expansion
@@ -418,56 +454,58 @@ static struct symbol *find_internal_exported (struct symbol_list *symlist,
  * "__ksymtab_" string must be stripped off to create the name of the symbol
  * in the symbol list that has the iformation we really want.
  */
-static inline void process_symname(struct symbol *sym, struct sparm *parent)
+static inline void process_symname(struct kbunit *tu, struct symbol *sym,
+				   struct sparm *parent)
 {
 	int offset = strlen(ksymprefix);
 	char *symname = &sym->ident->name[offset];
 	struct symbol *lsym;
-	if ((lsym = find_internal_exported(symlist, symname)))
+	if ((lsym = find_internal_exported(tu->symlist, symname))) {
+		tu->exported = true;
 		build_branch(lsym, parent);
+	}
 }
 
 /******************************************************************************
  * PFX_KSYMTAB:
- * build_tree_ksymtabs(symbol_list *symlist, sparm *parent)
+ * build_tree_ksymtabs(kbunit *tu, sparm *parent)
  *
  * Search the symbol_list for symbols that begin with "__ksymtab_", which
  * identifies them as exported. If found, start the processing.
  */
-static void build_tree_ksymtabs(struct symbol_list *symlist,
-				struct sparm *parent)
+static void build_tree_ksymtabs(struct kbunit *tu, struct sparm *parent)
 {
 	struct symbol *sym;
 
-	FOR_EACH_PTR(symlist, sym) {
+	FOR_EACH_PTR(tu->symlist, sym) {
 
 		if (sym->ident &&
 		    begins_with(sym->ident->name, ksymprefix))
-			process_symname(sym, parent);
+			process_symname(tu, sym, parent);
 
 	} END_FOR_EACH_PTR(sym);
 }
 
 /******************************************************************************
  * PFX_GENKSYM:
- * is_exported(symbol *sym)
+ * is_exported(kbunit *tu, symbol *sym)
  *
  * If the symbol has a valid basetpe, then search the input file for an
  * EXPORT_SYMBOL line that contains the symbol name.
  *
  */
-static bool is_exported(struct symbol *sym)
+static bool is_exported(struct kbunit *tu, struct symbol *sym)
 {
 	char *symname = sym->ident->name;
 
 	if (!sym->ident->name || !(is_valid_basetype(sym->ctype.base_type)))
 		return false;
 
-	rewind(inputfile);
+	rewind(tu->inputfile);
 
-	while (!feof(inputfile)) {
+	while (!feof(tu->inputfile)) {
 		char line[512];
-		fgets(line, 512, inputfile);
+		fgets(line, 512, tu->inputfile);
 
 		if (strstr(line, symname) && strstr(line, "EXPORT"))
 			return true;
@@ -478,27 +516,303 @@ static bool is_exported(struct symbol *sym)
 
 /******************************************************************************
  * PFX_GENKSYM:
- * build_tree_genksyms(char *file, symbol_list *symlist, sparm *parent)
+ * build_tree_genksyms(kbunit *tu, sparm *parent)
  *
  * Search the symbol_list for exported symbols identified by being contained
  * in a line having "EXPORT_SYMBOL". When found, start the processing.
  */
-static void build_tree_genksyms(char *file,
-				struct symbol_list *symlist,
-			        struct sparm *parent)
+static void build_tree_genksyms(struct kbunit *tu, struct sparm *parent)
 {
 	struct symbol *sym;
 
-	inputfile = fopen(file, "r");
+	tu->inputfile = fopen(tu->file, "r");
 
-	FOR_EACH_PTR(symlist, sym) {
+	if (!tu->inputfile)
+		return;
 
-		if (sym->ident && is_exported(sym))
+	FOR_EACH_PTR(tu->symlist, sym) {
+
+		if (sym->ident && is_exported(tu, sym)) {
+			tu->exported = true;
 			build_branch(sym, parent);
+		}
 
 	} END_FOR_EACH_PTR(sym);
 
-	fclose(inputfile);
+	fclose(tu->inputfile);
+	tu->inputfile = NULL;
+}
+
+/******************************************************************************
+ * has_exports(const char *file)
+ *
+ * Whether the text of the file has the scan string of pfxtab, which any file
+ * that exports a symbol must have. Most files in a kernel tree export
+ * nothing, and finding that out with memmem, which glibc vectorizes, on the
+ * mapped file costs little next to a sparse pass. A file that cannot be
+ * mapped is left to sparse.
+ */
+static bool has_exports(const char *file)
+{
+	const char *scan = pfxtab[pfxidx].scan;
+	bool found = true;
+	struct stat st;
+	void *buf;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0)
+		return true;
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode)) {
+		if (!st.st_size) {
+			found = false;
+		} else {
+			buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				   fd, 0);
+
+			if (buf != MAP_FAILED) {
+				found = memmem(buf, st.st_size,
+					       scan, strlen(scan)) != NULL;
+				munmap(buf, st.st_size);
+			}
+		}
+	}
+
+	close(fd);
+	return found;
+}
+
+/******************************************************************************
+ * parse_unit(kbunit *tu)
+ *
+ * Run sparse on the file of the translation unit and add the hierarchies
+ * of its exported symbols to the graph of the current kbparsectx. The
+ * callers only parse the files that has_exports() lets through.
+ */
+static void parse_unit(struct kbunit *tu)
+{
+	struct sparm *sp = kb_new_firstsparm(tu->file);
+
+	prdbg("sparse file: %s\n", tu->file);
+	tu->symlist = __sparse(tu->file);
+
+	if (pfxidx == PFX_KSYMTAB)
+		build_tree_ksymtabs(tu, sp);
+	else
+		build_tree_genksyms(tu, sp);
+}
+
+/*****************************************************
+** Parsing a list of files
+******************************************************/
+
+/******************************************************************************
+ * get_graphname(const char *file)
+ *
+ * The graph of foo.i is foo.kbg, as kabi-data.sh names it. The caller frees
+ * the name.
+ */
+static char *get_graphname(const char *file)
+{
+	const char *slash = strrchr(file, '/');
+	const char *dot = strrchr(file, '.');
+	size_t len = (dot && (!slash || dot > slash)) ? dot - file
+						      : strlen(file);
+	char *graph = malloc(len + strlen(graphext) + 1);
+
+	if (!graph)
+		return NULL;
+
+	memcpy(graph, file, len);
+	strcpy(&graph[len], graphext);
+	return graph;
+}
+
+/******************************************************************************
+ * read_filelist(const char *listfile, int *count)
+ *
+ * Read the names of the .i files, one per line, from the list file, or from
+ * stdin if it is "-". Blank lines are skipped. Returns NULL if the list
+ * cannot be read. Exits if there is not the memory to hold all of it.
+ */
+static char **read_filelist(const char *listfile, int *count)
+{
+	FILE *fp = strcmp(listfile, "-") ? fopen(listfile, "r") : stdin;
+	char **files = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int max = 0;
+
+	*count = 0;
+
+	if (!fp)
+		return NULL;
+
+	while ((len = getline(&line, &size, fp)) >= 0) {
+		while (len && isspace((unsigned char)line[len - 1]))
+			line[--len] = '\0';
+
+		if (!len)
+			continue;
+
+		if (*count == max) {
+			char **more;
+
+			max = max ? max * 2 : 256;
+			more = realloc(files, max * sizeof(char *));
+
+			if (!more)
+				goto nomem;
+
+			files = more;
+		}
+
+		if (!(files[*count] = strdup(line)))
+			goto nomem;
+
+		++(*count);
+	}
+
+	free(line);
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return files ? files : calloc(1, sizeof(char *));
+
+	// A list cut short would leave files unparsed without a word.
+nomem:
+	while (*count)
+		free(files[--(*count)]);
+
+	free(files);
+	free(line);
+	printf("Out of memory reading file list: %s\n", listfile);
+	exit(1);
+}
+
+/******************************************************************************
+ * parse_to_graph(char *file)
+ *
+ * Parse one file into a kbparsectx of its own and write its graph. A file
+ * that exports nothing gets no graph, and its name is not printed, so it is
+ * left out of the list of graphs. Returns nonzero if the graph was not
+ * written, other than for a file that exports nothing without -r.
+ */
+static int parse_to_graph(char *file)
+{
+	struct kbparsectx *ctx;
+	struct kbunit tu = { file, NULL, NULL, false };
+	char *graph = get_graphname(file);
+	int status = 0;
+
+	if (!graph)
+		return 1;
+
+	if (!has_exports(file)) {
+		prdbg("no exports: %s\n", file);
+
+		// Nor may a graph from an earlier parse be left.
+		remove(graph);
+		free(graph);
+		return report ? 1 : 0;
+	}
+
+	ctx = kb_new_parsectx();
+	kb_set_parsectx(ctx);
+	parse_unit(&tu);
+
+	if (report && !tu.exported) {
+		status = 1;
+	} else {
+		// The text archive is appended to, so start afresh.
+		remove(graph);
+		kb_write_dnodemap(graph);
+		printf("%s\n", graph);
+		fflush(stdout);
+	}
+
+	kb_free_parsectx(ctx);
+	free(graph);
+	return status;
+}
+
+/******************************************************************************
+ * parse_worker(char **files, int count, int *next)
+ *
+ * Take the next file that no other worker has taken, until there are none
+ * left. Files differ a lot in size, so taking them one at a time keeps the
+ * workers equally busy.
+ */
+static int parse_worker(char **files, int count, int *next)
+{
+	int status = 0;
+	int index;
+
+	while ((index = __sync_fetch_and_add(next, 1)) < count)
+		status |= parse_to_graph(files[index]);
+
+	return status;
+}
+
+/******************************************************************************
+ * parse_jobs(char **files, int count)
+ *
+ * Parse the files with the number of worker processes given by -j, one by
+ * default. sparse keeps the state of its parse in globals, so the workers
+ * are processes rather than threads. They are forked after sparse has been
+ * initialized, so that is done once, and each one parses many files. A
+ * worker that sparse ends with a fatal error is replaced while there are
+ * files left.
+ * Returns nonzero if any graph was not written.
+ */
+static int parse_jobs(char **files, int count)
+{
+	int *next = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	int running = 0;
+	int status = 0;
+	int wstatus;
+	int first = 0;
+
+	if (next == MAP_FAILED)
+		return parse_worker(files, count, &first);
+
+	*next = 0;
+	fflush(stdout);
+
+	while (running || (*next < count)) {
+		pid_t pid;
+
+		if ((running < jobs) && (*next < count)) {
+			pid = fork();
+
+			if (pid == 0)
+				_exit(parse_worker(files, count, next));
+
+			if (pid > 0) {
+				++running;
+				continue;
+			}
+
+			if (!running) {
+				status = 1;
+				break;
+			}
+		}
+
+		if (wait(&wstatus) < 0)
+			break;
+
+		--running;
+
+		if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+			status = 1;
+	}
+
+	munmap(next, sizeof(int));
+	return status;
 }
 
 /*****************************************************
@@ -533,6 +847,14 @@ static bool parse_opt(char opt, char ***argv, int *index)
 		   break;
 	case 'x' : kp_rmfiles = true;
 		   break;
+	case 'b' : kb_set_binmap(true);
+		   break;
+	case 'z' : kb_set_zstdmap(true);
+		   graphext = ".kbg.zst";
+		   break;
+	case 't' : kb_set_typestore(*((*argv)++));
+		   ++(*index);
+		   break;
 	case 'h' : puts(helptext);
 		   exit(0);
 	case 'p' : if (!set_pfx(*((*argv)++)))
@@ -541,6 +863,14 @@ static bool parse_opt(char opt, char ***argv, int *index)
 		   break;
 	case 'r' : report = true;
 		   break;
+	case 'l' : listfilename = *((*argv)++);
+		   ++(*index);
+		   break;
+	case 'j' : jobs = atoi(*((*argv)++));
+		   ++(*index);
+		   if (jobs < 1)
+			   optstatus = false;
+		   break;
 	case 'S' : *(++spargvp) = *((*argv)++);
 		   ++(*index);
 		   ++sparseargc;
@@ -586,6 +916,9 @@ int main(int argc, char **argv)
 	int argindex = 0;
 	char *file;
 	struct string_list *filelist = NULL;
+	struct kbunit tu = { NULL, NULL, NULL, false };
+	bool exported = false;
+	bool parsed = false;
 
 	DBG(setbuf(stdout, NULL);)
 
@@ -601,6 +934,29 @@ int main(int argc, char **argv)
 	argv[argindex] = argv[0];
 	argv += argindex;
 	argc -= argindex;
+
+	// Each file in the list gets a graph of its own, so the list cannot
+	// be added to the files of sparse, nor to a cumulative graph.
+	if (listfilename) {
+		char **files;
+		int count;
+
+		if (infilespec || cumulative) {
+			puts("-l cannot be used with -f or -c");
+			return 1;
+		}
+
+		files = read_filelist(listfilename, &count);
+
+		if (!files) {
+			printf("Cannot read file list: %s\n", listfilename);
+			return 1;
+		}
+
+		sparse_initialize(sparseargc, sparseargv, &filelist);
+		return parse_jobs(files, count);
+	}
+
 	sparseargv[sparseargc] = infilespec;
 	++sparseargc;
 
@@ -609,21 +965,31 @@ int main(int argc, char **argv)
 		remove(datafilename);
 	}
 
-	symlist = sparse_initialize(sparseargc, sparseargv, &filelist);
+	sparse_initialize(sparseargc, sparseargv, &filelist);
 
 	FOR_EACH_PTR_NOTAG(filelist, file) {
-		struct sparm *sp = kb_new_firstsparm(file);
-		prdbg("sparse file: %s\n", file);
-		symlist = __sparse(file);
-
-		if (pfxidx == PFX_KSYMTAB)
-			build_tree_ksymtabs(symlist, sp);
-		else
-			build_tree_genksyms(file, symlist, sp);
+		if (!has_exports(file)) {
+			prdbg("no exports: %s\n", file);
+			continue;
+		}
 
+		tu.file = file;
+		tu.exported = false;
+		parse_unit(&tu);
+		exported |= tu.exported;
+		parsed = true;
 	} END_FOR_EACH_PTR_NOTAG(file);
 
-	if (report && !kabiflag)
+	// Files that export nothing get no graph, unless they are added to a
+	// cumulative one, which must be written back.
+	if (!parsed && !cumulative) {
+		if (kp_rmfiles)
+			remove(datafilename);
+
+		return report ? 1 : 0;
+	}
+
+	if (report && !exported)
 		return 1;
 
 	if (kp_rmfiles)
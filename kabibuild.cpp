@@ -0,0 +1,1055 @@
+/* kabibuild.cpp - class to build the graph files of a kernel tree
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * Finds the .i files in a kernel tree and runs kabi-parser on each of them,
+ * as many at once as there are processors, starting with the largest. The
+ * exit status and time of each parse are logged, and the graphs that were
+ * written are listed in redhat/kabi/kabi-datafiles.list in order of their
+ * names, so the list is the same from one build to the next.
+ *
+ * A manifest records the content hash of each .i file that was parsed, and
+ * of the parser and its options. A file whose hash has not changed keeps the
+ * graph it has, so a rebuild only parses what is new.
+ *
+ * In update mode, the dependencies kbuild recorded in the .cmd file of each
+ * .i file tell which of them are out of date with the sources and headers,
+ * and only those are made again before they are parsed.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "kabibuild.h"
+
+using namespace std;
+
+string kabibuild::get_helptext()
+{
+	return "\
+kabi-build [-bztnqau] [-p path] [-s subdir] [-f file-list] [-j jobs]\n\
+           [-e errfile] [-l logfile] [-m manifest] [-P parser]\n\
+           [-c changes]\n\
+    Runs kabi-parser on every .i file in the kernel tree, as many at once\n\
+    as there are processors, largest first. Each foo.i gets a graph file\n\
+    foo.kbg, unless it exports nothing, and the graphs are listed in the\n\
+    file list in order of their names. The list is replaced in one step\n\
+    when the build is done.\n\
+    The exit status and time of every parse are written to the log file.\n\
+    The paths of the files are relative to the top of the kernel tree.\n\
+    A .i file is only parsed again if its contents, the parser, or the\n\
+    options have changed since the graph was written, as the manifest\n\
+    records them.\n\
+\n\
+    -p path     - Path to top of kernel tree, if operating in a different\n\
+                  directory.\n\
+    -s subdir   - Only parse the .i files under subdir of the kernel tree.\n\
+    -f filelist - List of the graph files written. The default is\n\
+                  redhat/kabi/kabi-datafiles.list\n\
+    -j jobs     - Number of files parsed at once. The default is the\n\
+                  number of online processors.\n\
+    -e errfile  - File for the messages of kabi-parser and sparse. The\n\
+                  default is /dev/null\n\
+    -l logfile  - Log of the status and time of each file. The default\n\
+                  is redhat/kabi/kabi-build.log\n\
+    -m manifest - Hashes of the files the graphs were written from. The\n\
+                  default is redhat/kabi/kabi-build.manifest\n\
+    -P parser   - The kabi-parser to run, if it is not in the PATH.\n\
+    -b          - Write the graphs in the binary format.\n\
+    -z          - Compress the graphs with zstd, as foo.kbg.zst\n\
+    -t          - Keep the data types in the type store in\n\
+                  redhat/kabi/types. See kabi-parser -t.\n\
+    -n          - Do not run kabi-index on the file list afterwards.\n\
+    -q          - Do not show progress.\n\
+    -a          - Parse all the files, whatever the manifest says.\n\
+    -u          - Update mode. Make the .i files again with the kernel\n\
+                  make, before they are parsed, if a file they depend on\n\
+                  is newer than they are. The dependencies are read from\n\
+                  the .foo.i.cmd or .foo.o.cmd files kbuild wrote.\n\
+    -c changes  - Update mode, with the files that depend on the files\n\
+                  in the changes file made again, rather than the ones\n\
+                  that are older than their dependencies. The changes\n\
+                  file has one path in a line, as from git diff\n\
+                  --name-only, and is read from stdin if it is -\n\
+    -h          - this help message.\n";
+}
+
+/************************************************
+** main()
+************************************************/
+int main(int argc, char **argv)
+{
+	kabibuild kb(argc, argv);
+	return kb.run();
+}
+
+kabibuild::kabibuild(int argc, char **argv)
+{
+	if (process_args(argc, argv)) {
+		cout << get_helptext();
+		exit(1);
+	}
+}
+
+int kabibuild::process_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:s:f:j:e:l:m:P:c:bztnqauh")) != -1) {
+		switch (opt) {
+		case 'p' : m_userdir = optarg;
+			   break;
+		case 's' : m_subdir = optarg;
+			   break;
+		case 'f' : m_filelist = optarg;
+			   break;
+		case 'j' : m_jobs = atoi(optarg);
+			   if (m_jobs < 1)
+				   return -1;
+			   break;
+		case 'e' : m_errfile = optarg;
+			   break;
+		case 'l' : m_logfile = optarg;
+			   break;
+		case 'm' : m_manfile = optarg;
+			   break;
+		case 'P' : m_parser = optarg;
+			   break;
+		case 'b' : m_binary = true;
+			   break;
+		case 'z' : m_zstd = true;
+			   break;
+		case 't' : m_storedir = "redhat/kabi/types";
+			   break;
+		case 'n' : m_index = false;
+			   break;
+		case 'q' : m_quiet = true;
+			   break;
+		case 'a' : m_all = true;
+			   break;
+		case 'u' : m_update = true;
+			   break;
+		case 'c' : m_changes = optarg;
+			   m_update = true;
+			   break;
+		case 'h' : cout << get_helptext();
+			   exit(0);
+		default  : return -1;
+		}
+	}
+
+	return optind < argc ? -1 : 0;
+}
+
+/*****************************************************************************
+ * make_dirs(const string& path)
+ *
+ * Create the directories leading to the file, as mkdir -p would.
+ */
+static void make_dirs(const string& path)
+{
+	size_t pos = 0;
+
+	while ((pos = path.find('/', pos + 1)) != string::npos)
+		mkdir(path.substr(0, pos).c_str(), 0755);
+}
+
+/*****************************************************************************
+ * hash_bytes(const char *buf, size_t len, uint64_t hash)
+ *
+ * A fast 64 bit hash, a word at a time. Each step is a bijection of the
+ * hash, so two buffers that differ in only one word never hash the same.
+ */
+static uint64_t hash_bytes(const char *buf, size_t len, uint64_t hash)
+{
+	const uint64_t mult = 0x9e3779b97f4a7c15ULL;
+	uint64_t word;
+	size_t total = len;
+
+	for (; len >= sizeof(word); buf += sizeof(word), len -= sizeof(word)) {
+		memcpy(&word, buf, sizeof(word));
+		hash = (hash ^ word) * mult;
+		hash ^= hash >> 32;
+	}
+
+	word = 0;
+	memcpy(&word, buf, len);
+	hash = (hash ^ word ^ total) * mult;
+	return hash ^ (hash >> 29);
+}
+
+/*****************************************************************************
+ * hash_file(const string& path, uint64_t& hash)
+ *
+ * Hash the contents of the file. Returns nonzero if it cannot be read.
+ */
+static int hash_file(const string& path, uint64_t& hash)
+{
+	struct stat st;
+	void *buf;
+	int fd;
+
+	if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+		return -1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		hash = hash_bytes("", 0, 0);
+		return 0;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (buf == MAP_FAILED)
+		return -1;
+
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+	hash = hash_bytes((const char *)buf, st.st_size, 0);
+	munmap(buf, st.st_size);
+	return 0;
+}
+
+/*****************************************************************************
+ * find_program(const string& name)
+ *
+ * The path execvp would run for the name, or the name if none is found.
+ */
+static string find_program(const string& name)
+{
+	const char *path = getenv("PATH");
+	string dir;
+
+	if ((name.find('/') != string::npos) || !path)
+		return name;
+
+	istringstream iss(path);
+
+	while (getline(iss, dir, ':')) {
+		string file = (dir.empty() ? "." : dir) + "/" + name;
+
+		if (access(file.c_str(), X_OK) == 0)
+			return file;
+	}
+
+	return name;
+}
+
+/*****************************************************************************
+ * kabibuild::find_sources()
+ *
+ * Walk the tree below the subdirectory for .i files, keeping a stack of the
+ * directories still to be read. Symbolic links are not followed, as with
+ * find. The largest files are parsed first, so that one of them does not
+ * keep a processor busy long after the others are done.
+ */
+void kabibuild::find_sources()
+{
+	vector<string> dirs;
+	string top = m_subdir.empty() ? "." : m_subdir;
+
+	while ((top.size() > 1) && (top.back() == '/'))
+		top.pop_back();
+
+	dirs.push_back(top);
+
+	while (!dirs.empty()) {
+		string dir = dirs.back();
+		DIR *dp = opendir(dir.c_str());
+		struct dirent *de;
+
+		dirs.pop_back();
+
+		if (!dp) {
+			cout << "Cannot open directory: " << dir << endl;
+			continue;
+		}
+
+		while ((de = readdir(dp))) {
+			string name = de->d_name;
+			string path = (dir == ".") ? name : dir + "/" + name;
+			struct stat st;
+
+			if ((name == ".") || (name == "..") ||
+			    lstat(path.c_str(), &st))
+				continue;
+
+			if (S_ISDIR(st.st_mode)) {
+				dirs.push_back(path);
+				continue;
+			}
+
+			if (!S_ISREG(st.st_mode) || (name.size() < 3) ||
+			    (name.compare(name.size() - 2, 2, ".i") != 0))
+				continue;
+
+			kbsource src;
+			src.source = path;
+			src.graph = path.substr(0, path.size() - 2) +
+				    (m_zstd ? ".kbg.zst" : ".kbg");
+			src.size = st.st_size;
+			src.mtime = st.st_mtim.tv_sec * 1000000000LL +
+				    st.st_mtim.tv_nsec;
+			m_sources.push_back(src);
+		}
+
+		closedir(dp);
+	}
+
+	sort(m_sources.begin(), m_sources.end(),
+		[](const kbsource& a, const kbsource& b) {
+			return a.size != b.size ? a.size > b.size
+						: a.source < b.source;
+		});
+}
+
+/*****************************************************************************
+ * trim(const string& str)
+ */
+static string trim(const string& str)
+{
+	size_t first = str.find_first_not_of(" \t\r");
+	size_t last = str.find_last_not_of(" \t\r");
+
+	return first == string::npos ? "" : str.substr(first, last - first + 1);
+}
+
+/*****************************************************************************
+ * rel_path(const string& path, const string& top)
+ *
+ * The path relative to the top of the kernel tree, as kbuild and git have
+ * them, if it is in the tree.
+ */
+static string rel_path(const string& path, const string& top)
+{
+	size_t pos = 0;
+
+	while (path.compare(pos, 2, "./") == 0)
+		pos += 2;
+
+	if (!top.empty() && (path.size() > top.size()) &&
+	    (path.compare(0, top.size(), top) == 0) &&
+	    (path[top.size()] == '/'))
+		pos = top.size() + 1;
+
+	return path.substr(pos);
+}
+
+/*****************************************************************************
+ * kabibuild::read_changes()
+ *
+ * Read the paths of the changed files. Returns nonzero if they cannot be.
+ */
+int kabibuild::read_changes()
+{
+	ifstream ifs;
+	istream *is = &cin;
+	string line;
+
+	if (m_changes != "-") {
+		ifs.open(m_changes);
+
+		if (!ifs.is_open()) {
+			cout << "Cannot open file: " << m_changes << endl;
+			return 1;
+		}
+
+		is = &ifs;
+	}
+
+	while (getline(*is, line))
+		if (!(line = trim(line)).empty())
+			m_changed.insert(rel_path(line, m_topdir));
+
+	return 0;
+}
+
+/*****************************************************************************
+ * kabibuild::find_deps(const string& source, vector<string>& deps)
+ *
+ * Read the dependencies of a .i file from the .cmd file kbuild wrote for
+ * it, or for the .o file made from the same source. The file has the source
+ * on its source_ line and the headers on the lines after deps_, one to a
+ * line, each ending in a backslash but the last. The $(wildcard ...) lines
+ * name the config options the source uses, not files.
+ * Returns false if there is no .cmd file.
+ */
+bool kabibuild::find_deps(const string& source, vector<string>& deps)
+{
+	size_t pos = source.rfind('/');
+	string dir = (pos == string::npos) ? "" : source.substr(0, pos + 1);
+	string stem = source.substr(dir.size(), source.size() - dir.size() - 2);
+	bool indeps = false;
+	ifstream ifs;
+	string line;
+
+	for (auto ext : { ".i.cmd", ".o.cmd" }) {
+		ifs.open(dir + "." + stem + ext);
+
+		if (ifs.is_open())
+			break;
+
+		ifs.clear();
+	}
+
+	if (!ifs.is_open())
+		return false;
+
+	while (getline(ifs, line)) {
+		bool more;
+
+		if (!indeps) {
+			if ((pos = line.find(":=")) == string::npos)
+				continue;
+
+			if (line.compare(0, 7, "source_") == 0) {
+				deps.push_back(trim(line.substr(pos + 2)));
+				continue;
+			}
+
+			if (line.compare(0, 5, "deps_") != 0)
+				continue;
+
+			indeps = true;
+			line = line.substr(pos + 2);
+		}
+
+		line = trim(line);
+
+		if ((more = !line.empty() && (line.back() == '\\')))
+			line = trim(line.substr(0, line.size() - 1));
+
+		if (!line.empty() && (line[0] != '$'))
+			deps.push_back(line);
+
+		if (!more)
+			break;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ * kabibuild::is_changed(const string& dep, long long mtime)
+ *
+ * Whether the dependency is in the changes file, or without one, whether it
+ * is newer than the .i file. The headers are shared by most of the files, so
+ * each is only looked at once. One that is gone counts as changed.
+ */
+bool kabibuild::is_changed(const string& dep, long long mtime)
+{
+	string path = rel_path(dep, m_topdir);
+
+	if (!m_changes.empty())
+		return m_changed.count(path) != 0;
+
+	auto it = m_mtimes.find(path);
+
+	if (it == m_mtimes.end()) {
+		struct stat st;
+		long long depmtime = LLONG_MAX;
+
+		if (stat(path.c_str(), &st) == 0)
+			depmtime = st.st_mtim.tv_sec * 1000000000LL +
+				   st.st_mtim.tv_nsec;
+
+		it = m_mtimes.insert({ path, depmtime }).first;
+	}
+
+	return it->second > mtime;
+}
+
+/*****************************************************************************
+ * kabibuild::update_sources()
+ *
+ * Make the .i files that are out of date with the kernel make, as makei.sh
+ * does, a batch at a time so the command line is not too long. Without a
+ * .cmd file, all that is known is the .c file the .i came from. The files
+ * made again have their size and time looked at again. Whether they are
+ * parsed is up to their hash, as for any other, so one whose contents
+ * came out the same keeps its graph.
+ */
+void kabibuild::update_sources()
+{
+	const size_t batch = 1024;
+	vector<kbsource *> stale;
+
+	for (auto& src : m_sources) {
+		vector<string> deps;
+
+		if (!find_deps(src.source, deps))
+			deps.push_back(src.source.substr(0, src.source.size() - 2)
+				       + ".c");
+
+		for (auto& dep : deps) {
+			if (is_changed(dep, src.mtime)) {
+				stale.push_back(&src);
+				break;
+			}
+		}
+	}
+
+	if (stale.empty())
+		return;
+
+	if (!m_quiet)
+		cout << "Making " << stale.size() << " .i files" << endl;
+
+	for (size_t first = 0; first < stale.size(); first += batch) {
+		string jobs = "-j" + to_string(m_jobs);
+		vector<char *> argv = { (char *)"make", (char *)"-k",
+					(char *)jobs.c_str() };
+		size_t last = min(first + batch, stale.size());
+		pid_t pid;
+		int status;
+
+		for (size_t i = first; i < last; ++i)
+			argv.push_back((char *)stale[i]->source.c_str());
+
+		argv.push_back(NULL);
+		cout.flush();
+
+		if ((pid = fork()) < 0) {
+			cout << "Cannot run make" << endl;
+			break;
+		}
+
+		if (pid == 0) {
+			int fd = (m_errfd >= 0) ? m_errfd
+						: open("/dev/null", O_WRONLY);
+
+			if (fd >= 0) {
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+			}
+
+			execvp(argv[0], &argv[0]);
+			_exit(127);
+		}
+
+		waitpid(pid, &status, 0);
+	}
+
+	for (auto src : stale) {
+		struct stat st;
+
+		if (stat(src->source.c_str(), &st)) {
+			src->size = -1;
+			continue;
+		}
+
+		src->size = st.st_size;
+		src->mtime = st.st_mtim.tv_sec * 1000000000LL +
+			     st.st_mtim.tv_nsec;
+	}
+
+	// A .i file that make could not make again is gone.
+	m_sources.erase(remove_if(m_sources.begin(), m_sources.end(),
+		[](const kbsource& src) { return src.size < 0; }),
+		m_sources.end());
+}
+
+/*****************************************************************************
+ * kabibuild::get_parseropts()
+ *
+ * The options given kabi-parser for every file.
+ */
+vector<string> kabibuild::get_parseropts()
+{
+	vector<string> args;
+	string opts = "-x";
+
+	if (m_binary)
+		opts += "b";
+
+	if (m_zstd)
+		opts += "z";
+
+	args.push_back(opts);
+
+	if (!m_storedir.empty()) {
+		args.push_back("-t");
+		args.push_back(m_storedir);
+	}
+
+	args.push_back("-S");
+	args.push_back("-Wall_off");
+	return args;
+}
+
+/*****************************************************************************
+ * kabibuild::get_config()
+ *
+ * The hash of kabi-parser and its options. The parser has no version of its
+ * own, so it is known by the path, size and time of the program, which
+ * change whenever it is rebuilt or updated.
+ */
+uint64_t kabibuild::get_config()
+{
+	string parser = find_program(m_parser);
+	ostringstream config;
+	struct stat st;
+
+	config << parser;
+
+	if (stat(parser.c_str(), &st) == 0)
+		config << " " << st.st_size << " " << st.st_mtim.tv_sec
+		       << "." << st.st_mtim.tv_nsec;
+
+	for (auto& opt : get_parseropts())
+		config << " " << opt;
+
+	return hash_bytes(config.str().data(), config.str().size(), 0);
+}
+
+/*****************************************************************************
+ * kabibuild::read_manifest()
+ *
+ * Each line has the hash of a .i file, the hash of the parser and options it
+ * was parsed with, its size and time, 1 if it has a graph or 0 if it exports
+ * nothing, and the file. A manifest that is not there, or a line that cannot
+ * be read, only means more files are parsed.
+ */
+void kabibuild::read_manifest()
+{
+	ifstream ifs(m_manfile);
+	string line;
+
+	while (getline(ifs, line)) {
+		istringstream iss(line);
+		kbentry entry;
+		string source;
+		int graph = 0;
+
+		if (line.empty() || (line[0] == '#'))
+			continue;
+
+		iss >> hex >> entry.hash >> entry.config >> dec
+		    >> entry.size >> entry.mtime >> graph >> ws;
+
+		if (iss.fail() || !getline(iss, source) || source.empty())
+			continue;
+
+		entry.nograph = !graph;
+		m_manifest[source] = entry;
+	}
+}
+
+/*****************************************************************************
+ * kabibuild::check_sources()
+ *
+ * Hash each .i file, and keep its graph if the manifest has the same hash
+ * for it, with the same parser and options. A file with the size and time
+ * the manifest has for it is not read again for its hash, as git does with
+ * its index. A file that was only touched is read, but not parsed. A file
+ * that exported nothing is kept as it is, without a graph.
+ */
+void kabibuild::check_sources()
+{
+	for (auto& src : m_sources) {
+		auto it = m_manifest.find(src.source);
+		bool known = it != m_manifest.end();
+
+		if (known && (it->second.size == src.size) &&
+		    (it->second.mtime == src.mtime))
+			src.hash = it->second.hash;
+		else if (hash_file(src.source, src.hash))
+			continue;
+
+		if (m_all || !known || (it->second.hash != src.hash) ||
+		    (it->second.config != m_config) ||
+		    (!it->second.nograph && access(src.graph.c_str(), F_OK)))
+			continue;
+
+		src.status = 0;
+		src.reused = true;
+		src.nograph = it->second.nograph;
+	}
+}
+
+/*****************************************************************************
+ * kabibuild::write_manifest()
+ *
+ * Record the files that have a graph now, and those that export nothing,
+ * so they are not parsed again either. The files of the last manifest
+ * that were not looked at, because they are outside the subdirectory, are
+ * kept. Like the file list, the manifest is renamed over the old one.
+ */
+int kabibuild::write_manifest()
+{
+	string tmpfile = m_manfile + "." + to_string(getpid());
+	ofstream ofs;
+
+	for (auto& src : m_sources) {
+		if (src.status != 0) {
+			m_manifest.erase(src.source);
+			continue;
+		}
+
+		kbentry& entry = m_manifest[src.source];
+
+		entry.hash = src.hash;
+		entry.config = m_config;
+		entry.size = src.size;
+		entry.mtime = src.mtime;
+		entry.nograph = src.nograph;
+	}
+
+	make_dirs(m_manfile);
+	ofs.open(tmpfile);
+
+	if (!ofs.is_open()) {
+		cout << "Cannot open file: " << tmpfile << endl;
+		return 1;
+	}
+
+	ofs << "# hash config size mtime graph source\n" << setfill('0');
+
+	for (auto& it : m_manifest)
+		ofs << hex << setw(16) << it.second.hash << " " << setw(16)
+		    << it.second.config << " " << dec << setw(0)
+		    << it.second.size << " " << it.second.mtime << " "
+		    << !it.second.nograph << " " << it.first << "\n";
+
+	ofs.close();
+
+	if (ofs.fail() || rename(tmpfile.c_str(), m_manfile.c_str())) {
+		cout << "Cannot write file: " << m_manfile << endl;
+		remove(tmpfile.c_str());
+		return 1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * kabibuild::start(kbsource& src)
+ *
+ * Run kabi-parser on one file, with its messages going to the error file.
+ * The old graph is removed first, so that a graph is only there afterwards
+ * if this parse wrote it. Returns the pid, or -1 if it could not be run.
+ */
+pid_t kabibuild::start(kbsource& src)
+{
+	vector<string> args = get_parseropts();
+	vector<char *> argv;
+	pid_t pid;
+
+	args.insert(args.begin(), m_parser);
+	args.insert(args.end() - 2, { "-o", src.graph, "-f", src.source });
+
+	for (auto& arg : args)
+		argv.push_back((char *)arg.c_str());
+
+	argv.push_back(NULL);
+
+	remove(src.graph.c_str());
+	src.start = clock::now();
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	if (m_errfd >= 0)
+		dup2(m_errfd, STDERR_FILENO);
+
+	// kabi-parser prints nothing on stdout that the build wants.
+	int fd = open("/dev/null", O_WRONLY);
+
+	if (fd >= 0)
+		dup2(fd, STDOUT_FILENO);
+
+	execvp(argv[0], &argv[0]);
+	_exit(127);
+}
+
+/*****************************************************************************
+ * kabibuild::finish(kbsource& src, int wstatus)
+ *
+ * A parse succeeded if kabi-parser exited with zero. It leaves no graph for
+ * a file that exports nothing, and a file with no graph is not listed. A
+ * parser killed by a signal gets the status the shell would give it.
+ */
+void kabibuild::finish(kbsource& src, int wstatus)
+{
+	chrono::duration<double> elapsed = clock::now() - src.start;
+
+	src.seconds = elapsed.count();
+	src.status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus)
+					: 128 + WTERMSIG(wstatus);
+
+	if ((src.status == 0) && access(src.graph.c_str(), F_OK))
+		src.nograph = true;
+}
+
+/*****************************************************************************
+ * kabibuild::write_filelist()
+ *
+ * The list is written to a temporary file and renamed over the old one, so
+ * a reader never sees it half written. The graphs are in order of their
+ * names, whatever order they were finished in.
+ */
+int kabibuild::write_filelist()
+{
+	string tmpfile = m_filelist + "." + to_string(getpid());
+	vector<string> graphs;
+	ofstream ofs;
+
+	for (auto& src : m_sources)
+		if ((src.status == 0) && !src.nograph)
+			graphs.push_back(src.graph);
+
+	sort(graphs.begin(), graphs.end());
+
+	make_dirs(m_filelist);
+	ofs.open(tmpfile);
+
+	if (!ofs.is_open()) {
+		cout << "Cannot open file: " << tmpfile << endl;
+		return 1;
+	}
+
+	for (auto& graph : graphs)
+		ofs << graph << "\n";
+
+	ofs.close();
+
+	if (ofs.fail() || rename(tmpfile.c_str(), m_filelist.c_str())) {
+		cout << "Cannot write file: " << m_filelist << endl;
+		remove(tmpfile.c_str());
+		return 1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * kabibuild::write_log()
+ *
+ * One line for each .i file, in order of their names: the exit status of
+ * kabi-parser, the seconds it took, and the file.
+ * A file that was not parsed again has a - for its seconds.
+ */
+void kabibuild::write_log()
+{
+	vector<const kbsource *> sources;
+	ofstream ofs;
+
+	for (auto& src : m_sources)
+		sources.push_back(&src);
+
+	sort(sources.begin(), sources.end(),
+		[](const kbsource *a, const kbsource *b) {
+			return a->source < b->source;
+		});
+
+	make_dirs(m_logfile);
+	ofs.open(m_logfile);
+
+	if (!ofs.is_open()) {
+		cout << "Cannot open file: " << m_logfile << endl;
+		return;
+	}
+
+	ofs << fixed << setprecision(3);
+
+	for (auto src : sources) {
+		ofs << setw(4) << src->status << " " << setw(10);
+
+		if (src->reused)
+			ofs << "-";
+		else
+			ofs << src->seconds;
+
+		ofs << " " << src->source << "\n";
+	}
+}
+
+/*****************************************************************************
+ * kabibuild::run_index()
+ *
+ * Index the new graphs, as kabi-data.sh does, if kabi-index is installed.
+ */
+void kabibuild::run_index()
+{
+	pid_t pid;
+	int status;
+
+	cout.flush();
+
+	if ((pid = fork()) < 0)
+		return;
+
+	if (pid == 0) {
+		execlp("kabi-index", "kabi-index", "-q", "-f",
+		       m_filelist.c_str(), (char *)NULL);
+		_exit(127);
+	}
+
+	waitpid(pid, &status, 0);
+}
+
+int kabibuild::run()
+{
+	map<pid_t, size_t> running;	// pid of each parser, and its file
+	clock::time_point begin = clock::now();
+	chrono::duration<double> elapsed;
+	size_t next = 0;
+	size_t done = 0;
+	size_t todo = 0;
+	int reused = 0;
+	int nograph = 0;
+	int failed = 0;
+	char *topdir;
+
+	// The changes file is named from where kabi-build was run, but its
+	// paths may be in the tree.
+	if ((topdir = realpath(m_userdir.empty() ? "." : m_userdir.c_str(),
+			       NULL))) {
+		m_topdir = topdir;
+		free(topdir);
+	}
+
+	if (!m_changes.empty() && read_changes())
+		return 1;
+
+	if (!m_userdir.empty() && chdir(m_userdir.c_str())) {
+		cout << "Cannot access directory: " << m_userdir << endl;
+		return 1;
+	}
+
+	find_sources();
+
+	m_errfd = open(m_errfile.c_str(),
+		       O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (m_errfd < 0)
+		cout << "Cannot open file: " << m_errfile << endl;
+
+	if (!m_jobs)
+		m_jobs = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+	if (m_update)
+		update_sources();
+
+	m_config = get_config();
+	read_manifest();
+	check_sources();
+
+	for (auto& src : m_sources)
+		if (src.reused)
+			++reused;
+
+	todo = m_sources.size() - reused;
+
+	// The output of the parsers must not be buffered before the fork.
+	cout.flush();
+
+	while (true) {
+		int wstatus;
+		pid_t pid;
+
+		while ((next < m_sources.size()) && m_sources[next].reused)
+			++next;
+
+		if ((next == m_sources.size()) && running.empty())
+			break;
+
+		if ((next < m_sources.size()) &&
+		    (running.size() < (size_t)m_jobs)) {
+
+			if ((pid = start(m_sources[next])) > 0) {
+				running[pid] = next++;
+				continue;
+			}
+
+			// Try again when a parser finishes, unless there
+			// are none to wait for.
+			if (running.empty()) {
+				cout << "Cannot run " << m_parser << endl;
+				break;
+			}
+		}
+
+		if ((pid = waitpid(-1, &wstatus, 0)) < 0)
+			break;
+
+		auto it = running.find(pid);
+
+		if (it == running.end())
+			continue;
+
+		finish(m_sources[it->second], wstatus);
+		running.erase(it);
+		++done;
+
+		if (!m_quiet)
+			cerr << "\33[2K\r" << done << "/" << todo;
+	}
+
+	if (m_errfd >= 0)
+		close(m_errfd);
+
+	if (!m_quiet)
+		cerr << "\33[2K\r";
+
+	for (auto& src : m_sources) {
+		if (src.nograph && !src.reused)
+			++nograph;
+
+		if (src.status == 0)
+			continue;
+
+		cout << "Failed: " << src.source << endl;
+		++failed;
+	}
+
+	write_log();
+
+	if (write_filelist() | write_manifest())
+		return 1;
+
+	elapsed = clock::now() - begin;
+	cout << todo - failed - nograph << " graphs written, " << nograph
+	     << " without exports, " << reused << " unchanged, " << failed
+	     << " failed, in " << (int)elapsed.count() << " seconds" << endl;
+
+	if (m_index)
+		run_index();
+
+	return failed ? 1 : 0;
+}
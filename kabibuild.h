@@ -0,0 +1,125 @@
+#ifndef KABIBUILD_H
+#define KABIBUILD_H
+
+/* kabibuild.h - class to build the graph files of a kernel tree
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * Finds the .i files in a kernel tree and runs kabi-parser on each of them,
+ * as many at once as there are processors, starting with the largest. The
+ * exit status and time of each parse are logged, and the graphs that were
+ * written are listed in redhat/kabi/kabi-datafiles.list in order of their
+ * names, so the list is the same from one build to the next.
+ *
+ * A manifest records the content hash of each .i file that was parsed, and
+ * of the parser and its options. A file whose hash has not changed keeps the
+ * graph it has, so a rebuild only parses what is new.
+ *
+ * In update mode, the dependencies kbuild recorded in the .cmd file of each
+ * .i file tell which of them are out of date with the sources and headers,
+ * and only those are made again before they are parsed.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <sys/types.h>
+
+class kabibuild
+{
+public:
+	kabibuild(){}
+	kabibuild(int argc, char **argv);
+	int run();
+	static std::string get_helptext();
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	// A .i file to parse, and what became of it.
+	struct kbsource {
+		std::string source;	// the .i file
+		std::string graph;	// the graph written from it
+		off_t size = 0;
+		long long mtime = 0;	// nanoseconds
+		uint64_t hash = 0;	// of the contents of the .i file
+		int status = -1;	// exit status of kabi-parser
+		bool reused = false;	// unchanged, so the graph was kept
+		bool nograph = false;	// exports nothing, so has no graph
+		clock::time_point start;
+		double seconds = 0;
+	};
+
+	// What the manifest knows of a .i file from the last build.
+	struct kbentry {
+		uint64_t hash = 0;
+		uint64_t config = 0;	// of kabi-parser and its options
+		off_t size = 0;
+		long long mtime = 0;
+		bool nograph = false;
+	};
+
+	int process_args(int argc, char **argv);
+	void find_sources();
+	int read_changes();
+	bool find_deps(const std::string& source,
+		       std::vector<std::string>& deps);
+	bool is_changed(const std::string& dep, long long mtime);
+	void update_sources();
+	std::vector<std::string> get_parseropts();
+	uint64_t get_config();
+	void read_manifest();
+	void check_sources();
+	int write_manifest();
+	pid_t start(kbsource& src);
+	void finish(kbsource& src, int wstatus);
+	int write_filelist();
+	void write_log();
+	void run_index();
+
+	std::vector<kbsource> m_sources;
+	std::map<std::string, kbentry> m_manifest;
+	std::unordered_set<std::string> m_changed;	// see is_changed()
+	std::unordered_map<std::string, long long> m_mtimes;
+	std::string m_filelist = "redhat/kabi/kabi-datafiles.list";
+	std::string m_logfile = "redhat/kabi/kabi-build.log";
+	std::string m_manfile = "redhat/kabi/kabi-build.manifest";
+	std::string m_changes;
+	std::string m_topdir;
+	std::string m_errfile = "/dev/null";
+	std::string m_parser = "kabi-parser";
+	std::string m_userdir;
+	std::string m_subdir;
+	std::string m_storedir;
+	int m_errfd = -1;
+	int m_jobs = 0;
+	uint64_t m_config = 0;
+	bool m_binary = false;
+	bool m_zstd = false;
+	bool m_index = true;
+	bool m_quiet = false;
+	bool m_all = false;
+	bool m_update = false;
+};
+
+#endif // KABIBUILD_H
@@ -0,0 +1,256 @@
+/* kabiconvert.cpp - class to convert graph files to another format
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * Trees of graph files written by older versions of kabi-parser can be
+ * brought up to the current format without rebuilding the kernel. Each
+ * graph file in the file list is read, written again in the chosen
+ * format, and only replaced if the new file reads back as the same graph.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "kabiconvert.h"
+
+using namespace std;
+
+string kabiconvert::get_helptext()
+{
+	return "\
+kabi-convert [-tzq] [-f file-list] [-j jobs] [-p path] [-s storedir]\n\
+    Converts the graph files in the file list to the binary format, or to\n\
+    another format given by the switches. Each file is replaced only if\n\
+    the converted graph reads back the same as the original, and keeps\n\
+    its name, so the file list stays valid.\n\
+\n\
+    -f filelist - List of graph files created by kabi-parser. The default\n\
+                  is redhat/kabi/kabi-datafiles.list\n\
+    -j jobs     - Number of files converted at once. The default is the\n\
+                  number of online processors.\n\
+    -p path     - Path to top of kernel tree, if operating in a different\n\
+                  directory.\n\
+    -s storedir - Move the data types to the type store in storedir.\n\
+                  See kabi-parser -t.\n\
+    -t          - Write boost text archives instead of the binary format.\n\
+    -z          - Compress the graphs with zstd.\n\
+    -q          - Do not show progress.\n\
+    -h          - this help message.\n";
+}
+
+/************************************************
+** main()
+************************************************/
+int main(int argc, char **argv)
+{
+	kabiconvert kc(argc, argv);
+	return kc.run();
+}
+
+kabiconvert::kabiconvert(int argc, char **argv)
+{
+	if (process_args(argc, argv)) {
+		cout << get_helptext();
+		exit(1);
+	}
+}
+
+int kabiconvert::process_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:j:p:s:tzqh")) != -1) {
+		switch (opt) {
+		case 'f' : m_filelist = optarg;
+			   break;
+		case 'j' : m_jobs = atoi(optarg);
+			   if (m_jobs < 1)
+				   return -1;
+			   break;
+		case 'p' : m_userdir = optarg;
+			   break;
+		case 's' : m_storedir = optarg;
+			   break;
+		case 't' : m_text = true;
+			   break;
+		case 'z' : m_zstd = true;
+			   break;
+		case 'q' : m_quiet = true;
+			   break;
+		case 'h' : cout << get_helptext();
+			   exit(0);
+		default  : return -1;
+		}
+	}
+
+	return optind < argc ? -1 : 0;
+}
+
+/******************************************************************************
+ * kabiconvert::convert(string& datafile)
+ *
+ * The graph is written to a temporary file next to the original, which is
+ * only replaced once the dump of the new file matches the dump of the old
+ * one. The dump shows every field of every node, and does not depend on
+ * the format the graph was read from.
+ */
+int kabiconvert::convert(const string& datafile)
+{
+	dnodemap dnmap;
+	ostringstream before;
+	ostringstream after;
+	string tmpfile = datafile + "." + to_string(getpid());
+
+	if (kb_read_dnodemap(datafile, dnmap) != 0)
+		return -1;
+
+	kb_dump_dnodemap(before, dnmap);
+	kb_write_dnodemap_other(tmpfile, dnmap);
+	dnmap.clear();
+
+	if (kb_read_dnodemap(tmpfile, dnmap) == 0)
+		kb_dump_dnodemap(after, dnmap);
+
+	if (before.str() != after.str()) {
+		cout << "Converted graph differs: " << datafile << endl;
+		remove(tmpfile.c_str());
+		return -1;
+	}
+
+	if (rename(tmpfile.c_str(), datafile.c_str())) {
+		cout << "Cannot write file: " << datafile << endl;
+		remove(tmpfile.c_str());
+		return -1;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * kabiconvert::work(int worker, int fd)
+ *
+ * Each worker is a process of its own, so that the graphs and the string
+ * table of one don't get in the way of the others. Worker n converts every
+ * m_jobs'th file starting at n, and writes the number it converted to fd
+ * when done.
+ */
+void kabiconvert::work(int worker, int fd)
+{
+	int converted = 0;
+
+	kb_set_binmap(!m_text);
+	kb_set_zstdmap(m_zstd);
+
+	if (!m_storedir.empty())
+		kb_set_typestore(m_storedir.c_str());
+
+	for (size_t i = worker; i < m_datafiles.size(); i += m_jobs) {
+
+		if (!m_quiet && (worker == 0))
+			cerr << "\33[2K\r" << i << "/" << m_datafiles.size();
+
+		if (convert(m_datafiles[i]) == 0)
+			++converted;
+	}
+
+	if (write(fd, &converted, sizeof(converted)) != sizeof(converted))
+		exit(1);
+
+	close(fd);
+}
+
+int kabiconvert::run()
+{
+	ifstream ifs;
+	string datafile;
+	vector<pair<pid_t, int> > workers;
+	int converted = 0;
+	int failed;
+
+	if (!m_userdir.empty() && chdir(m_userdir.c_str())) {
+		cout << "Cannot access directory: " << m_userdir << endl;
+		return 1;
+	}
+
+	ifs.open(m_filelist);
+
+	if (!ifs.is_open()) {
+		cout << "Cannot open file: " << m_filelist << endl;
+		return 1;
+	}
+
+	while (getline(ifs, datafile))
+		m_datafiles.push_back(datafile);
+
+	ifs.close();
+
+	if (!m_jobs)
+		m_jobs = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+	if ((size_t)m_jobs > m_datafiles.size())
+		m_jobs = max((size_t)1, m_datafiles.size());
+
+	// The output of the workers must not be buffered before the fork.
+	cout.flush();
+
+	for (int worker = 0; worker < m_jobs; ++worker) {
+		int fds[2];
+		pid_t pid;
+
+		if (pipe(fds) || ((pid = fork()) < 0)) {
+			cout << "Cannot start worker " << worker << endl;
+			return 1;
+		}
+
+		if (pid == 0) {
+			close(fds[0]);
+			work(worker, fds[1]);
+			exit(0);
+		}
+
+		close(fds[1]);
+		workers.push_back(make_pair(pid, fds[0]));
+	}
+
+	// A worker that dies before reporting leaves its files unaccounted
+	// for, which counts them as failed.
+	for (auto& it : workers) {
+		int count;
+		int status;
+
+		if (read(it.second, &count, sizeof(count)) == sizeof(count))
+			converted += count;
+
+		close(it.second);
+		waitpid(it.first, &status, 0);
+	}
+
+	failed = m_datafiles.size() - converted;
+
+	if (!m_quiet)
+		cerr << "\33[2K\r" << converted << " files converted, "
+		     << failed << " failed" << endl;
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#ifndef KABICONVERT_H
+#define KABICONVERT_H
+
+/* kabiconvert.h - class to convert graph files to another format
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * Trees of graph files written by older versions of kabi-parser can be
+ * brought up to the current format without rebuilding the kernel. Each
+ * graph file in the file list is read, written again in the chosen
+ * format, and only replaced if the new file reads back as the same graph.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include "kabi-map.h"
+
+class kabiconvert
+{
+public:
+	kabiconvert(){}
+	kabiconvert(int argc, char **argv);
+	int run();
+	static std::string get_helptext();
+
+private:
+	int process_args(int argc, char **argv);
+	int convert(const std::string& datafile);
+	void work(int worker, int fd);
+
+	std::vector<std::string> m_datafiles;
+	std::string m_filelist = "redhat/kabi/kabi-datafiles.list";
+	std::string m_userdir;
+	std::string m_storedir;
+	int m_jobs = 0;
+	bool m_text = false;
+	bool m_zstd = false;
+	bool m_quiet = false;
+};
+
+#endif // KABICONVERT_H
@@ -0,0 +1,166 @@
+/* kabiindex.cpp - class to index the graph files created by kabi-parser
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * A whole word search in kabi-lookup reads every graph file in the file
+ * list, though most of them do not have the symbol. This utility writes
+ * an index of the crcs in each graph file next to the file list, so that
+ * kabi-lookup can read only the files that have the symbol.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "kabiindex.h"
+
+using namespace std;
+
+string kabiindex::get_helptext()
+{
+	return "\
+kabi-index [-q] [-f file-list] [-o index] [-b manifest] [-r reach] [-p path]\n\
+           [-c catalog] [-s symvers]\n\
+    Writes an index of the symbols in each graph file of the file list,\n\
+    a manifest of Bloom filters of the symbols of each graph file, an\n\
+    index of the exported functions that reach each symbol, and a catalog\n\
+    of the exported functions. kabi-lookup uses them to read only the\n\
+    graph files that may have the symbol, and lists exports from the\n\
+    catalog. Run it again whenever the file list or the graph files\n\
+    change.\n\
+\n\
+    -f filelist - List of graph files created by kabi-parser. The default\n\
+                  is redhat/kabi/kabi-datafiles.list\n\
+    -o index    - The index. The default is the file list with an .idx\n\
+                  extension, e.g. redhat/kabi/kabi-datafiles.idx\n\
+    -b manifest - The Bloom manifest. The default is the file list with a\n\
+                  .blm extension, e.g. redhat/kabi/kabi-datafiles.blm\n\
+    -r reach    - The reachability index. The default is the file list\n\
+                  with an .rch extension, e.g. redhat/kabi/kabi-datafiles.rch\n\
+    -c catalog  - The export catalog. The default is the file list with a\n\
+                  .cat extension, e.g. redhat/kabi/kabi-datafiles.cat\n\
+    -s symvers  - Where to find the module of each export. The default is\n\
+                  Module.symvers at the top of the kernel tree.\n\
+    -p path     - Path to top of kernel tree, if operating in a different\n\
+                  directory.\n\
+    -q          - Do not show progress.\n\
+    -h          - this help message.\n";
+}
+
+/************************************************
+** main()
+************************************************/
+int main(int argc, char **argv)
+{
+	kabiindex ki(argc, argv);
+	return ki.run();
+}
+
+kabiindex::kabiindex(int argc, char **argv)
+{
+	if (process_args(argc, argv)) {
+		cout << get_helptext();
+		exit(1);
+	}
+}
+
+int kabiindex::process_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:o:b:r:c:s:p:qh")) != -1) {
+		switch (opt) {
+		case 'f' : m_filelist = optarg;
+			   break;
+		case 'o' : m_outfile = optarg;
+			   break;
+		case 'b' : m_bloomfile = optarg;
+			   break;
+		case 'r' : m_reachfile = optarg;
+			   break;
+		case 'c' : m_catalogfile = optarg;
+			   break;
+		case 's' : m_symvers = optarg;
+			   break;
+		case 'p' : m_userdir = optarg;
+			   break;
+		case 'q' : m_quiet = true;
+			   break;
+		case 'h' : cout << get_helptext();
+			   exit(0);
+		default  : return -1;
+		}
+	}
+
+	if (m_outfile.empty())
+		m_outfile = kb_get_index_name(m_filelist);
+
+	if (m_bloomfile.empty())
+		m_bloomfile = kb_get_bloom_name(m_filelist);
+
+	if (m_reachfile.empty())
+		m_reachfile = kb_get_reach_name(m_filelist);
+
+	if (m_catalogfile.empty())
+		m_catalogfile = kb_get_catalog_name(m_filelist);
+
+	return optind < argc ? -1 : 0;
+}
+
+int kabiindex::run()
+{
+	ifstream ifs;
+	string datafile;
+	int count = 0;
+
+	if (!m_userdir.empty() && chdir(m_userdir.c_str())) {
+		cout << "Cannot access directory: " << m_userdir << endl;
+		return 1;
+	}
+
+	ifs.open(m_filelist);
+
+	if (!ifs.is_open()) {
+		cout << "Cannot open file: " << m_filelist << endl;
+		return 1;
+	}
+
+	m_indexer.read_symvers(m_symvers);
+
+	while (getline(ifs, datafile)) {
+
+		if (!m_quiet)
+			cerr << "\33[2K\r" << datafile;
+
+		if (m_indexer.add_file(datafile) == 0)
+			++count;
+	}
+
+	ifs.close();
+
+	if (!m_quiet)
+		cerr << "\33[2K\r" << count << " files indexed" << endl;
+
+	if (m_indexer.write(m_outfile) || m_indexer.write_bloom(m_bloomfile) ||
+	    m_indexer.write_reach(m_reachfile) ||
+	    m_indexer.write_catalog(m_catalogfile))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef KABIINDEXER_H
+#define KABIINDEXER_H
+
+/* kabiindex.h - class to index the graph files created by kabi-parser
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * A whole word search in kabi-lookup reads every graph file in the file
+ * list, though most of them do not have the symbol. This utility writes
+ * an index of the crcs in each graph file next to the file list, so that
+ * kabi-lookup can read only the files that have the symbol.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <string>
+#include "kabi-index.h"
+
+class kabiindex
+{
+public:
+	kabiindex(){}
+	kabiindex(int argc, char **argv);
+	int run();
+	static std::string get_helptext();
+
+private:
+	int process_args(int argc, char **argv);
+
+	kbindexer m_indexer;
+	std::string m_filelist = "redhat/kabi/kabi-datafiles.list";
+	std::string m_outfile;
+	std::string m_bloomfile;
+	std::string m_reachfile;
+	std::string m_catalogfile;
+	std::string m_symvers = "Module.symvers";
+	std::string m_userdir;
+	bool m_quiet = false;
+};
+
+#endif // KABIINDEXER_H
@@ -21,9 +21,17 @@
  */
 
 #include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cerrno>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 #include <boost/tokenizer.hpp>
@@ -62,14 +70,17 @@ kabi-lookup Version 3.6.2\n\
 string lookup::get_helptext()
 {
 	return "\
-kabi-lookup [-vwl] -e|s|c|d symbol [-f file-list] [-m mask] [-p path] \n\
+kabi-lookup [-vwl] -e|s|c|d|x symbol [-f file-list | -g graph] [-m mask] [-p path] \n\
+            [-j jobs] [-S socket] [-r | --regex | --glob] [--max-depth N] \n\
+kabi-lookup -b queries [-f file-list | -g graph] [-p path] [-S socket] \n\
+kabi-lookup -D socket -g graph [-p path] \n\
     Searches a kabi database for symbols. The results of the search \n\
     are printed to stdout and indented hierarchically.\n\
 \n\
-    Switches e,s,c,d are required, but mutually exlusive. \n\
+    Switches e,s,c,d,x are required, but mutually exlusive. \n\
     Only one can be selected. \n\
 \n\
-    Switches v,w,l,m,p, and f are optional. \n\
+    Switches v,w,l,m,p,f and g are optional. \n\
     Switch l must be used with switch w, or the program will exit with\n\
     a message. All may be used concurrently.\n\
 \n\
@@ -93,6 +104,10 @@ kabi-lookup [-vwl] -e|s|c|d symbol [-f file-list] [-m mask] [-p path] \n\
     -d symbol   - Seeks a data structure and prints its members to stdout. \n\
                   With the -v switch, descendants of nonscalar members will \n\
                   also be printed.\n\
+    -x scope    - Lists the exported functions whose source file or module\n\
+                  contains scope, e.g. drivers/net or vmlinux, with their \n\
+                  source files, modules and signature crcs. Use '' for all.\n\
+                  Needs the export catalog made by kabi-index.\n\
     -l          - White listed symbols only. Limits search to symbols in the\n\
                   kabi white list, if it exists.\n\
     -m mask     - Limits the search to directories and files containing the\n\
@@ -102,10 +117,36 @@ kabi-lookup [-vwl] -e|s|c|d symbol [-f file-list] [-m mask] [-p path] \n\
                   directory.\n\
     -v          - Verbose output. Default is quiet.\n\
     -w          - Whole word search, default is substring match. \n\
+    -r, --regex - The symbol is a regular expression, e.g.\n\
+                  '^dma_.*_attrs$'. It matches anywhere unless anchored.\n\
+    --glob      - The symbol is a shell wildcard pattern that must match \n\
+                  the whole name, e.g. 'struct *_ops'. \n\
+                  Neither can be used with -w or -l.\n\
+    --max-depth N \n\
+                - Print no more than N levels of descendants below the \n\
+                  symbol with -d or -e, for a quick partial answer about \n\
+                  a large structure.\n\
     -f filelist - Optional path to list of data files created by kabi-parser\n\
                   during the kernel build, or using the kabi-data.sh script.\n\
                   The default path is redhat/kabi/kabi-datafiles.list \n\
                   relative to the top of the kernel tree.\n\
+    -g graph    - Search the single kernel-wide graph created by kabi-merge,\n\
+                  instead of the data files in the file list. The -m mask \n\
+                  is applied to the source file of each symbol.\n\
+    -j jobs     - Search the data files with this many processes. The \n\
+                  results are printed in file list order, exactly as \n\
+                  without -j. Ignored with -g.\n\
+    -b queries  - Run every search in the queries file, or stdin if it \n\
+                  is -, in one pass over the data files. Each line holds \n\
+                  the switches and symbol of one search, quoted as on \n\
+                  the command line, e.g. -sw 'struct device'. The output \n\
+                  of each search follows a ==> search <== header.\n\
+    -D socket   - Run as a server. Read the graph once and answer the \n\
+                  queries of kabi-lookup -S on the Unix socket.\n\
+    -S socket   - Send the query to the server on the Unix socket. The \n\
+                  results are the same as without -S. Only a query that\n\
+                  names the graph of the server with -g is answered \n\
+                  from the graph in its memory.\n\
     -V          - Print version number.\n\
     -h          - this help message.\n";
 }
@@ -125,6 +166,8 @@ int main(int argc, char *argv[])
  */
 lookup::lookup(int argc, char **argv)
 {
+	m_argc = argc;
+	m_argv = argv;
 	m_err.init(argc, argv);
 
 	if ((m_errindex = process_args(argc, argv))) {
@@ -157,6 +200,11 @@ int lookup::process_args(int argc, char **argv)
 	if (m_flags < 0 || !check_flags())
 		return EXE_BADFORM;
 
+	if (!m_pattern.compile(m_declstr, (m_flags & KB_REGEX) ? PAT_REGEX :
+					  (m_flags & KB_GLOB) ? PAT_GLOB :
+					  PAT_PLAIN))
+		return EXE_INVARG;
+
 	return EXE_OK;
 }
 
@@ -168,9 +216,31 @@ bool lookup::check_flags()
 	if ((m_flags & KB_VERBOSE) && (m_flags & KB_QUIET))
 		return false;
 
+	// A pattern is matched against every string in the graph, so it
+	// cannot be a whole word, which is looked up by its crc.
+	if (m_flags & (KB_REGEX | KB_GLOB)) {
+		if ((m_flags & KB_REGEX) && (m_flags & KB_GLOB))
+			return false;
+
+		if (m_flags & (KB_WHOLE_WORD | KB_SERVER | KB_BATCH))
+			return false;
+	}
+
+	// The server only answers the queries of its clients.
+	if (m_flags & KB_SERVER)
+		return (m_flags & KB_GRAPH) &&
+		       !(m_flags & (m_exemask | KB_CLIENT | KB_BATCH));
+
+	// A batch takes its searches from the query lines.
+	if (m_flags & KB_BATCH)
+		return !(m_flags & m_exemask);
+
 	if ((m_flags & KB_WHITE_LIST) && !(m_flags & KB_WHOLE_WORD))
 		return false;
 
+	if ((m_flags & KB_LIST) && (m_flags & KB_WHITE_LIST))
+		return false;
+
 	return (count_bits(m_flags & m_exemask) == 1);
 }
 
@@ -193,15 +263,54 @@ int lookup::count_bits(unsigned mask)
 int lookup::run()
 {
 	ifstream ifs;
+	istringstream graph(m_opts.graphfile);
+	istream& datafiles = (m_flags & KB_GRAPH) ? (istream&)graph : ifs;
+	size_t filenum = 0;
+	bool parallel = (m_opts.jobs > 1) && !(m_flags & KB_GRAPH);
+
+	if (m_flags & KB_SERVER)
+		return serve();
+
+	if (m_flags & KB_CLIENT)
+		return query_server();
+
+	if ((m_flags & KB_BATCH) && !read_batch())
+		goto lookup_error;
 
 	if (set_working_directory())
 		goto lookup_error;
 
-	m_filelist = m_kabidir + m_filelist;
-	ifs.open(m_filelist);
+	// The exports are listed from the catalog of the file list alone.
+	if (m_flags & KB_LIST) {
+		int status = exe_list();
 
-	if (!ifs.is_open())
-		report_nopath(m_filelist.c_str(), "file");
+		if (status == EXE_NOTFOUND)
+			m_errvec.push_back(m_declstr);
+
+		m_err.print_errmsg(status, m_errvec);
+		set_start_directory();
+		return status;
+	}
+
+	// A kernel-wide graph from kabi-merge stands in for the whole list.
+	if (!(m_flags & KB_GRAPH)) {
+		m_filelist = m_kabidir + m_filelist;
+		ifs.open(m_filelist);
+
+		if (!ifs.is_open())
+			report_nopath(m_filelist.c_str(), "file");
+
+		if (m_flags & (KB_WHOLE_WORD | KB_EXPORTS))
+			open_index();
+	}
+
+	if (m_flags & KB_BATCH) {
+		int status = run_batch(datafiles);
+
+		ifs.close();
+		set_start_directory();
+		return status;
+	}
 
 	if (m_flags & KB_WHITE_LIST) {
 		if (!build_whitelist())
@@ -211,14 +320,30 @@ int lookup::run()
 			m_errvec.push_back(m_declstr);
 			goto lookup_error;
 		}
+
+		if (m_kbrch.is_open() && !is_reach_whitelisted())
+			m_rchfiles.clear();
 	}
 
-	while (getline(ifs, m_datafile)) {
+	while (getline(datafiles, m_datafile)) {
+
+		if (!is_indexed(filenum++)) {
+			if (parallel)
+				m_jobs.push_back(make_pair(m_datafile, false));
+			m_errindex = ((m_flags & KB_COUNT) && m_count)
+				   ? EXE_OK : EXE_NOTFOUND;
+			continue;
+		}
 
-		if ((m_flags & KB_MASKSTR) &&
+		if ((m_flags & KB_MASKSTR) && !(m_flags & KB_GRAPH) &&
 		    (m_datafile.find(m_maskstr) == string::npos))
 			continue;
 
+		if (parallel) {
+			m_jobs.push_back(make_pair(m_datafile, true));
+			continue;
+		}
+
 		if (!(m_flags & KB_COUNT)) {
 			cerr << "\33[2K\r";	// return to start of line
 			cerr << m_datafile;
@@ -241,6 +366,9 @@ int lookup::run()
 			break;
 	}
 
+	if (!m_jobs.empty())
+		run_jobs();
+
 	if (m_flags & KB_COUNT)
 		cerr << "\33[2K\r" << m_count;
 
@@ -264,6 +392,708 @@ lookup_error:
 	return(m_errindex);
 }
 
+/*****************************************************************************
+ * Helpers for the pipes between lookup::run_jobs() and its workers.
+ */
+struct jobresult {
+	int32_t status;		// what execute() returned
+	int32_t count;		// m_count for the file
+	int32_t found;		// m_isfound for the file
+	uint32_t outsize;	// bytes of stdout that follow
+};
+
+static bool write_all(int fd, const void *buf, size_t size)
+{
+	const char *p = (const char *)buf;
+
+	while (size) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t size)
+{
+	char *p = (char *)buf;
+
+	while (size) {
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ * lookup::run_jobs()
+ *
+ * Search the data files in m_jobs with m_opts.jobs worker processes. Each
+ * worker searches every Nth file and sends back the stdout of each file
+ * through a pipe. The results are read back in file list order, so the
+ * output, the exit status and the early exits are the same as when the
+ * files are searched one after the other by run().
+ */
+void lookup::run_jobs()
+{
+	vector<size_t> work;	// the m_jobs that need to be searched
+	vector<pair<pid_t, int> > workers;
+
+	for (size_t i = 0; i < m_jobs.size(); ++i)
+		if (m_jobs[i].second)
+			work.push_back(i);
+
+	size_t nworkers = min((size_t)m_opts.jobs, work.size());
+
+	cout.flush();
+	cerr.flush();
+
+	for (size_t w = 0; w < nworkers; ++w) {
+		int fds[2];
+		pid_t pid;
+
+		if (pipe(fds) < 0 || (pid = fork()) < 0) {
+			perror("kabi-lookup");
+			nworkers = w;
+			break;
+		}
+
+		if (pid == 0) {
+			close(fds[0]);
+			for (auto wk : workers)
+				close(wk.second);
+			run_worker(work, w, nworkers, fds[1]);
+			_exit(0);
+		}
+
+		close(fds[1]);
+		workers.push_back(make_pair(pid, fds[0]));
+	}
+
+	for (size_t i = 0, next = 0; i < m_jobs.size(); ++i) {
+		jobresult res = { EXE_NOFILE, 0, 0, 0 };
+		string out;
+
+		if (!m_jobs[i].second) {
+			m_errindex = ((m_flags & KB_COUNT) && m_count)
+				   ? EXE_OK : EXE_NOTFOUND;
+			continue;
+		}
+
+		if (!(m_flags & KB_COUNT))
+			cerr << "\33[2K\r" << m_jobs[i].first;
+
+		// A worker that died takes the rest of its files with it.
+		if (nworkers) {
+			int fd = workers[next++ % nworkers].second;
+
+			if (read_all(fd, &res, sizeof(res))) {
+				out.resize(res.outsize);
+				if (!read_all(fd, &out[0], res.outsize))
+					res = { EXE_NOFILE, 0, 0, 0 };
+			} else {
+				res = { EXE_NOFILE, 0, 0, 0 };
+			}
+		}
+
+		cout << out;
+		m_count += res.count;
+		m_isfound = m_isfound || res.found;
+		m_errindex = res.status;
+
+		if ((m_flags & KB_COUNT) && (m_errindex != EXE_NOFILE))
+			m_errindex = put_count();
+
+		if (m_isfound && (m_flags & KB_WHOLE_WORD)
+			      && ((m_flags & KB_EXPORTS)
+			      ||  (m_flags & KB_DECL)))
+			break;
+
+		if (m_isfound && (m_flags & KB_JUSTONE))
+			break;
+	}
+
+	// Workers still searching are not needed any more.
+	for (auto wk : workers) {
+		close(wk.second);
+		kill(wk.first, SIGKILL);
+		waitpid(wk.first, NULL, 0);
+	}
+
+	m_jobs.clear();
+}
+
+/*****************************************************************************
+ * lookup::run_worker()
+ *
+ * Search every step'th file in work, starting with first, and write the
+ * result and the stdout of each to fd. The progress on stderr is left to
+ * run_jobs(). The counts and the found flag are per file, so that
+ * run_jobs() can add them up.
+ */
+void lookup::run_worker(const vector<size_t>& work, size_t first,
+			size_t step, int fd)
+{
+	ostringstream out;
+	ostringstream discard;
+
+	cout.rdbuf(out.rdbuf());
+	cerr.rdbuf(discard.rdbuf());
+
+	for (size_t n = first; n < work.size(); n += step) {
+		jobresult res;
+		string text;
+
+		out.str("");
+		discard.str("");
+		m_count = 0;
+		m_isfound = false;
+		m_datafile = m_jobs[work[n]].first;
+
+		res.status = execute(m_datafile);
+		res.count = m_count;
+		res.found = m_isfound;
+		text = out.str();
+		res.outsize = text.size();
+
+		if (!write_all(fd, &res, sizeof(res)) ||
+		    !write_all(fd, text.data(), text.size()))
+			break;
+	}
+
+	close(fd);
+}
+
+/*****************************************************************************
+ * lookup::read_batch()
+ *
+ * Read the queries for run_batch() from the file given with -b, or from
+ * stdin if it is "-". Each line holds the switches and the symbol of one
+ * search, quoted as they would be on the command line. Blank lines and
+ * lines starting with # are skipped.
+ */
+bool lookup::read_batch()
+{
+	ifstream ifs;
+	istream& in = (m_opts.batchfile == "-") ? cin : ifs;
+	string line;
+
+	if (m_opts.batchfile != "-") {
+		ifs.open(m_opts.batchfile);
+
+		if (!ifs.is_open()) {
+			m_errvec.push_back(m_opts.batchfile);
+			m_errvec.push_back(strerror(errno));
+			m_errindex = EXE_NOFILE;
+			return false;
+		}
+	}
+
+	while (getline(in, line)) {
+		boost::escaped_list_separator<char> sep("\\", " \t", "'\"");
+		tokenizer<boost::escaped_list_separator<char>> tok(line, sep);
+		kbquery *q = new kbquery;
+		lookup *lu;
+
+		q->line = line;
+		q->args.push_back(m_argv[0]);
+
+		try {
+			BOOST_FOREACH(string str, tok)
+				if (!str.empty())
+					q->args.push_back(str);
+		} catch (boost::escaped_list_error&) {
+			q->args.resize(1);	// reported as a bad query
+		}
+
+		if ((q->args.size() == 1 && line.find_first_not_of(" \t") ==
+		     string::npos) || (q->args.size() > 1 && q->args[1][0] == '#')) {
+			delete q;
+			continue;
+		}
+
+		for (auto& arg : q->args)
+			q->argv.push_back(&arg[0]);
+		q->argv.push_back(NULL);
+
+		q->lu = lu = new lookup;
+		lu->m_argc = q->argv.size() - 1;
+		lu->m_argv = q->argv.data();
+		lu->m_err.init(lu->m_argc, lu->m_argv);
+
+		if ((lu->m_errindex = lu->process_args(lu->m_argc, lu->m_argv))) {
+			lu->m_errvec.push_back(lu->m_declstr);
+			lu->m_errvec.push_back(lu->m_datafile);
+			q->failed = q->done = true;
+		}
+
+		m_batch.push_back(q);
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ * lookup::run_batch()
+ *
+ * Search the data files for all the queries read by read_batch(), reading
+ * each data file only once. The output of each query is kept apart and
+ * printed after a "==> query <==" header when all the files have been
+ * searched, exactly as kabi-lookup would print it for that query alone.
+ * Returns the exit status of the first query that failed, or EXE_OK.
+ */
+int lookup::run_batch(istream& datafiles)
+{
+	streambuf *out = cout.rdbuf();
+	streambuf *err = cerr.rdbuf();
+	ostringstream discard;
+	bool whitelist = false;
+	int status = EXE_OK;
+
+	for (auto q : m_batch)
+		if (!q->failed && (q->lu->m_flags & KB_WHITE_LIST))
+			whitelist = true;
+
+	if (whitelist)
+		whitelist = build_whitelist();
+
+	for (auto q : m_batch) {
+		lookup *lu = q->lu;
+
+		if (q->failed)
+			continue;
+
+		lu->m_flags = (lu->m_flags & ~KB_GRAPH) | (m_flags & KB_GRAPH);
+
+		// A list of exports does not need the data files.
+		if (lu->m_flags & KB_LIST) {
+			cout.rdbuf(q->out.rdbuf());
+			lu->m_errindex = lu->exe_list();
+			cout.rdbuf(out);
+			q->done = true;
+			continue;
+		}
+
+		if (!(lu->m_flags & KB_WHITE_LIST))
+			continue;
+
+		if (!whitelist) {
+			lu->m_errindex = EXE_NO_WLIST;
+			q->failed = q->done = true;
+			continue;
+		}
+
+		lu->m_white = m_white;
+
+		if (!lu->check_whitelist()) {
+			lu->m_errvec.push_back(lu->m_declstr);
+			q->failed = q->done = true;
+		}
+	}
+
+	while (getline(datafiles, m_datafile)) {
+		vector<kbquery *> active;
+		ostringstream loadout;
+		bool loaded;
+
+		for (auto q : m_batch) {
+			lookup *lu = q->lu;
+
+			if (q->done || ((lu->m_flags & KB_MASKSTR) &&
+			    !(m_flags & KB_GRAPH) &&
+			    (m_datafile.find(lu->m_maskstr) == string::npos)))
+				continue;
+
+			active.push_back(q);
+		}
+
+		if (active.empty())
+			continue;
+
+		cerr << "\33[2K\r" << m_datafile;
+
+		cout.rdbuf(loadout.rdbuf());
+		cerr.rdbuf(discard.rdbuf());
+		loaded = (kb_read_dnodemap(m_datafile, m_dnmap) == 0);
+
+		for (auto q : active) {
+			lookup *lu = q->lu;
+
+			cout.rdbuf(q->out.rdbuf());
+			cout << loadout.str();
+
+			lu->m_datafile = m_datafile;
+			lu->m_errindex = loaded ? lu->exe_query() : EXE_NOFILE;
+
+			if (lu->m_isfound && (lu->m_flags & KB_WHOLE_WORD)
+					  && ((lu->m_flags & KB_EXPORTS)
+					  ||  (lu->m_flags & KB_DECL)))
+				q->done = true;
+
+			if (lu->m_isfound && (lu->m_flags & KB_JUSTONE))
+				q->done = true;
+		}
+
+		cout.rdbuf(out);
+		cerr.rdbuf(err);
+		discard.str("");
+	}
+
+	cerr << "\33[2K\r";
+
+	for (auto q : m_batch) {
+		lookup *lu = q->lu;
+
+		cout.rdbuf(q->out.rdbuf());
+
+		if (!q->failed) {
+			cout << endl;
+
+			if (lu->m_isfound)
+				lu->m_errindex = EXE_OK;
+
+			lu->m_errvec.push_back(lu->m_declstr);
+		}
+
+		lu->m_err.print_errmsg(lu->m_errindex, lu->m_errvec);
+		cout.rdbuf(out);
+
+		cout << "==> " << q->line << " <==" << endl << q->out.str();
+
+		if (status == EXE_OK)
+			status = lu->m_errindex;
+
+		delete q;
+	}
+
+	m_batch.clear();
+	return status;
+}
+
+/*****************************************************************************
+ * Helpers for the socket between lookup::query_server() and lookup::serve().
+ *
+ * A query is a uint32_t size sent along with the client's stdin, stdout and
+ * stderr, followed by size bytes of NUL terminated strings: the working
+ * directory of the client, then its argv. The reply is the int32_t exit
+ * status of the query.
+ */
+#define KB_QUERY_MAX	(1 << 20)
+
+static bool set_addr(const string& path, sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (path.size() >= sizeof(addr.sun_path))
+		return false;
+
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+static bool send_query(int sock, const string& body)
+{
+	uint32_t size = body.size();
+	int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { &size, sizeof(size) };
+	struct msghdr msg;
+	struct cmsghdr *cm;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	if (sendmsg(sock, &msg, 0) != sizeof(size))
+		return false;
+
+	return write_all(sock, body.data(), body.size());
+}
+
+static bool get_query(int sock, int fds[3], vector<string>& strs)
+{
+	uint32_t size;
+	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
+	struct iovec iov = { &size, sizeof(size) };
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	string body;
+	size_t pos = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(sock, &msg, 0) != sizeof(size))
+		return false;
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm || cm->cmsg_type != SCM_RIGHTS ||
+	    cm->cmsg_len != CMSG_LEN(sizeof(int) * 3))
+		return false;
+
+	memcpy(fds, CMSG_DATA(cm), sizeof(int) * 3);
+
+	if (size > KB_QUERY_MAX)
+		return false;
+
+	body.resize(size);
+	if (!read_all(sock, &body[0], size))
+		return false;
+
+	while (pos < body.size()) {
+		size_t end = body.find('\0', pos);
+
+		if (end == string::npos)
+			break;
+
+		strs.push_back(body.substr(pos, end - pos));
+		pos = end + 1;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ * lookup::serve()
+ *
+ * Read the graph given with -g once, and answer the queries of kabi-lookup
+ * -S clients on the Unix socket given with -D until killed. Each query is
+ * run by a child with a copy-on-write copy of the graph, writing directly
+ * to the stdout and stderr of the client.
+ */
+int lookup::serve()
+{
+	sockaddr_un addr;
+	struct stat st;
+	char *graph;
+	int sock;
+
+	if (!set_addr(m_opts.socket, addr)) {
+		m_errvec.push_back(m_opts.socket);
+		m_errvec.push_back(strerror(ENAMETOOLONG));
+		m_errindex = EXE_NOFILE;
+		goto serve_error;
+	}
+
+	// A socket left behind by an earlier server is in the way.
+	if (!lstat(addr.sun_path, &st) && S_ISSOCK(st.st_mode))
+		unlink(addr.sun_path);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(sock, SOMAXCONN) < 0) {
+		m_errvec.push_back(m_opts.socket);
+		m_errvec.push_back(strerror(errno));
+		m_errindex = EXE_NOFILE;
+		if (sock >= 0)
+			close(sock);
+		goto serve_error;
+	}
+
+	if (set_working_directory()) {
+		close(sock);
+		unlink(addr.sun_path);
+		goto serve_error;
+	}
+
+	graph = realpath(m_opts.graphfile.c_str(), NULL);
+
+	if (!graph || kb_read_dnodemap(graph, m_dnmap) != 0) {
+		m_errvec.push_back(m_opts.graphfile);
+		m_errvec.push_back("cannot read graph");
+		m_errindex = EXE_NOFILE;
+		free(graph);
+		close(sock);
+		unlink(addr.sun_path);
+		goto serve_error;
+	}
+
+	m_resident = graph;
+	free(graph);
+
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;) {
+		int fd = accept(sock, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			m_errvec.push_back(m_opts.socket);
+			m_errvec.push_back(strerror(errno));
+			m_errindex = EXE_NOFILE;
+			break;
+		}
+
+		if (fork() == 0) {
+			close(sock);
+			signal(SIGCHLD, SIG_DFL);
+			_exit(serve_query(fd));
+		}
+
+		close(fd);
+	}
+
+	close(sock);
+	unlink(addr.sun_path);
+serve_error:
+	m_err.print_errmsg(m_errindex, m_errvec);
+	return m_errindex;
+}
+
+/*****************************************************************************
+ * lookup::serve_query()
+ *
+ * Read a query from the client on fd, run it in a child and send the exit
+ * status of the child back. The query is run exactly as kabi-lookup would
+ * run it in the client's directory. The graph of the server is only used in
+ * place of reading it again when the query names it with -g.
+ */
+int lookup::serve_query(int fd)
+{
+	int fds[3];
+	vector<string> strs;
+	int32_t status = EXE_NOFILE;
+	int wstatus;
+	pid_t pid;
+
+	if (!get_query(fd, fds, strs))
+		return 1;
+
+	if (strs.size() >= 2 && (pid = fork()) == 0) {
+		vector<char *> argv;
+
+		close(fd);
+		for (int i = 0; i < 3; ++i) {
+			dup2(fds[i], i);
+			close(fds[i]);
+		}
+
+		if (chdir(strs[0].c_str())) {
+			m_errvec.clear();
+			m_errvec.push_back(strs[0]);
+			m_err.print_errmsg(EXE_NODIR, m_errvec);
+			exit(EXE_NODIR);
+		}
+
+		for (size_t i = 1; i < strs.size(); ++i)
+			argv.push_back(&strs[i][0]);
+		argv.push_back(NULL);
+
+		lookup query(argv.size() - 1, argv.data());
+
+		query.m_flags &= ~KB_CLIENT;
+		query.m_resident = m_resident;
+		exit(query.run());
+	}
+
+	for (int i = 0; i < 3; ++i)
+		close(fds[i]);
+
+	if (strs.size() >= 2 && pid > 0 && waitpid(pid, &wstatus, 0) == pid)
+		status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus)
+					    : 128 + WTERMSIG(wstatus);
+
+	write_all(fd, &status, sizeof(status));
+	close(fd);
+	return 0;
+}
+
+/*****************************************************************************
+ * lookup::query_server()
+ *
+ * Send the command line to the server on the socket given with -S and
+ * return the exit status of the query. The server writes the results
+ * directly to our stdout and stderr.
+ */
+int lookup::query_server()
+{
+	sockaddr_un addr;
+	string body;
+	int32_t status;
+	int sock = -1;
+	char *pwd = get_current_dir_name();
+
+	body.append(pwd ? pwd : ".");
+	body.push_back('\0');
+	free(pwd);
+
+	for (int i = 0; i < m_argc; ++i) {
+		body.append(m_argv[i]);
+		body.push_back('\0');
+	}
+
+	m_errvec.push_back(m_opts.socket);
+	m_errindex = EXE_NOFILE;
+
+	if (!set_addr(m_opts.socket, addr)) {
+		m_errvec.push_back(strerror(ENAMETOOLONG));
+		goto query_error;
+	}
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    !send_query(sock, body)) {
+		m_errvec.push_back(strerror(errno));
+		goto query_error;
+	}
+
+	if (!read_all(sock, &status, sizeof(status))) {
+		m_errvec.push_back("no reply from server");
+		goto query_error;
+	}
+
+	close(sock);
+	return status;
+
+query_error:
+	if (sock >= 0)
+		close(sock);
+	m_err.print_errmsg(m_errindex, m_errvec);
+	return m_errindex;
+}
+
+/*****************************************************************************
+ * lookup::is_resident()
+ *
+ * Returns true if datafile is the graph that serve() keeps in the dnodemap.
+ */
+bool lookup::is_resident(const string& datafile)
+{
+	if (m_resident.empty())
+		return false;
+
+	char *path = realpath(datafile.c_str(), NULL);
+	bool resident = path && (m_resident == path);
+
+	free(path);
+	return resident;
+}
+
 /*****************************************************************************
  * void assure_trailing_slash()
  *
@@ -329,7 +1159,7 @@ int lookup::set_start_directory()
 /*****************************************************************************
  * lookup::check_whitelist()
  *
- * Check to see if the m_declstr is in the whitelist vector built by
+ * Check to see if the m_declstr is in the whitelist built by
  * build_whitelist()
  *
  */
@@ -349,13 +1179,7 @@ bool lookup::check_whitelist()
 			decl = m_declstr;
 	}
 
-	for (auto it : m_whitelist) {
-		if (decl == it) {
-			found = true;
-			break;
-		}
-	}
-
+	found = m_white->has(decl);
 	m_errindex = found ? EXE_OK : EXE_NOTWHITE;
 	return found;
 }
@@ -363,27 +1187,48 @@ bool lookup::check_whitelist()
 /*****************************************************************************
  * lookup::build_whitelist()
  *
- * Initialize the m_whitelist vector member with the symbols in the kabi
- * whitelists.
+ * Get the symbols in the kabi whitelists. They are read from the white list
+ * cache, unless a white list has been added, removed or changed since the
+ * cache was made. Then the white lists are read, and the cache is made
+ * again. If it cannot be written, the table is still used from memory.
  *
  */
 bool lookup::build_whitelist() {
 
 	struct dirent *ent;
-	bool found = false;
+	string cache = kb_get_whitelist_name(m_kabidir);
+	vector<string> sources;
+	vector<string> symbols;
 
 	if ((m_kbdir = opendir(m_kabidir.c_str())) == NULL)
 		report_nopath(m_kabidir.c_str(), "directory");
 
 	while ((ent = readdir(m_kbdir)) != NULL) {
-		string line;
 		string path = m_kabidir + string(ent->d_name);
-		ifstream ifs(path);
+		struct stat st;
 
-		if ((!ifs.is_open()) || (!strstr(ent->d_name, "Module.kabi")))
+		if (!strstr(ent->d_name, "Module.kabi") ||
+		    stat(path.c_str(), &st) || !S_ISREG(st.st_mode))
 			continue;
 
-		found = true;
+		sources.push_back(path);
+	}
+	closedir(m_kbdir);
+
+	if (sources.empty()) {
+		m_errindex = EXE_NO_WLIST;
+		return false;
+	}
+
+	sort(sources.begin(), sources.end());
+	m_errindex = EXE_OK;
+
+	if (m_kbwhite.open(cache) && m_kbwhite.is_current(sources))
+		return true;
+
+	for (auto& path : sources) {
+		string line;
+		ifstream ifs(path);
 
 		while (getline(ifs, line)) {
 			boost::char_separator<char> sep(" \t");
@@ -393,42 +1238,334 @@ bool lookup::build_whitelist() {
 			// Second token in the line is the whitelisted symbol
 			BOOST_FOREACH(string str, tok) {
 				if (++index == 2) {
-					m_whitelist.push_back(str);
+					symbols.push_back(str);
 					break;
 				}
 			}
 		}
-		ifs.close();
+		ifs.close();
+	}
+
+	m_kbwhite.build(symbols);
+	m_kbwhite.write(cache, sources);
+	return true;
+}
+
+/*****************************************************************************
+ * lookup::report_nopath(const char *name, const char *path)
+ */
+void lookup::report_nopath(const char* name, const char* path)
+{
+	cout << "\nCannot open " << path << ": " << name << endl;
+	exit(EXE_NOFILE);
+}
+
+/*****************************************************************************
+ * lookup::open_index()
+ *
+ * Open the index and the Bloom manifest that kabi-index writes next to the
+ * file list, and get the numbers of the data files that have the symbol.
+ * The index is not used if the file list is newer than the index. The Bloom
+ * filters are checked file by file, see kbbloom::may_have(). For a struct
+ * search, the reachability index also gives the exported functions that
+ * reach the symbol, and the files where they do. For an export search, the
+ * export catalog gives the files that export it, even by substring.
+ */
+void lookup::open_index()
+{
+	string idxfile = kb_get_index_name(m_filelist);
+	string rchfile = kb_get_reach_name(m_filelist);
+	struct stat liststat;
+	struct stat idxstat;
+	struct stat rchstat;
+
+	if (stat(m_filelist.c_str(), &liststat))
+		return;
+
+	if ((m_flags & KB_EXPORTS) && open_catalog(m_filelist))
+		get_catalog_files();
+
+	// The rest only has the crcs of whole words.
+	if (!(m_flags & KB_WHOLE_WORD))
+		return;
+
+	m_declcrc = raw_crc32(m_declstr.c_str());
+	m_kbblm.open(kb_get_bloom_name(m_filelist));
+
+	// Only a struct search is answered by the reachability index.
+	if ((m_flags & KB_STRUCT) && !stat(rchfile.c_str(), &rchstat) &&
+	    (rchstat.st_mtime >= liststat.st_mtime) && m_kbrch.open(rchfile))
+		m_kbrch.find(m_declcrc, m_rchexports, m_rchfiles);
+
+	if (stat(idxfile.c_str(), &idxstat) ||
+	    (idxstat.st_mtime < liststat.st_mtime))
+		return;
+
+	if (!m_kbidx.open(idxfile))
+		return;
+
+	m_kbidx.find(m_declcrc, m_idxfiles);
+}
+
+/*****************************************************************************
+ * lookup::open_catalog(string& filelist)
+ *
+ * Open the export catalog of the file list, unless it is older than the
+ * file list.
+ */
+bool lookup::open_catalog(const string& filelist)
+{
+	string catfile = kb_get_catalog_name(filelist);
+	struct stat liststat;
+	struct stat catstat;
+
+	if (stat(filelist.c_str(), &liststat) ||
+	    stat(catfile.c_str(), &catstat) ||
+	    (catstat.st_mtime < liststat.st_mtime))
+		return false;
+
+	return m_kbcat.open(catfile);
+}
+
+/*****************************************************************************
+ * lookup::get_catalog_files()
+ *
+ * Get the numbers of the data files that export a function matching the
+ * symbol from the catalog. A whole word, or a pattern that starts with a
+ * literal, only needs the range of the catalog with that prefix.
+ */
+void lookup::get_catalog_files()
+{
+	bool whole = m_flags & KB_WHOLE_WORD;
+	size_t first = 0;
+	size_t last = m_kbcat.count();
+
+	if (whole)
+		m_kbcat.find_prefix(m_declstr, &first, &last);
+	else if (m_pattern.anchored())
+		m_kbcat.find_prefix(m_pattern.literal(), &first, &last);
+
+	for (size_t i = first; i < last; ++i) {
+		const kbcatrec& cr = m_kbcat.rec(i);
+		const char *name = m_kbcat.str(cr.name);
+
+		if (whole ? (m_declstr == name) : m_pattern.match(name))
+			m_catfiles.push_back(cr.file);
+	}
+
+	sort(m_catfiles.begin(), m_catfiles.end());
+	m_catfiles.erase(unique(m_catfiles.begin(), m_catfiles.end()),
+			 m_catfiles.end());
+}
+
+/*****************************************************************************
+ * lookup::is_indexed(size_t filenum)
+ *
+ * Returns false if the export catalog, the reachability index or the index
+ * says that the data file at line filenum of the file list does not have
+ * the symbol. If the file does not match the one an index has for that
+ * line, that index is out of date and is dropped. Files the indexes do not
+ * cover are checked with their Bloom filters.
+ */
+bool lookup::is_indexed(size_t filenum)
+{
+	if (m_kbcat.is_open()) {
+		if ((filenum < m_kbcat.size()) &&
+		    (m_datafile == m_kbcat.file(filenum)))
+			return binary_search(m_catfiles.begin(),
+					     m_catfiles.end(), filenum);
+		m_kbcat.close();
+	}
+
+	if (m_kbrch.is_open()) {
+		if ((filenum < m_kbrch.size()) &&
+		    (m_datafile == m_kbrch.file(filenum)))
+			return binary_search(m_rchfiles.begin(),
+					     m_rchfiles.end(), filenum);
+		m_kbrch.close();
+	}
+
+	if (m_kbidx.is_open()) {
+		if ((filenum < m_kbidx.size()) &&
+		    (m_datafile == m_kbidx.file(filenum)))
+			return binary_search(m_idxfiles.begin(),
+					     m_idxfiles.end(), filenum);
+		m_kbidx.close();
+	}
+
+	return !m_kbblm.is_open() || m_kbblm.may_have(m_datafile, m_declcrc);
+}
+
+/*****************************************************************************
+ * lookup::is_reach_whitelisted()
+ *
+ * Returns true if any of the exported functions that the reachability index
+ * has for the symbol is white listed. If none is, a white listed struct
+ * search has nothing to show in any file.
+ */
+bool lookup::is_reach_whitelisted()
+{
+	for (uint32_t id : m_rchexports)
+		if (m_white->has(m_kbrch.export_name(id)))
+			return true;
+
+	return false;
+}
+
+/*****************************************************************************
+ * lookup::execute(string datafile)
+ *
+ * Each file is searched afresh. The dnodes already expanded and the rows
+ * already printed are forgotten, so what is printed for a file does not
+ * depend on the files searched before it, whether by this process or by
+ * another one with -j.
+ */
+int lookup::execute(string datafile)
+{
+	int status = 0;
+	bool resident = is_resident(datafile);
+
+	m_dups.clear();
+	m_rowman.reset();
+
+	// A substring search of a kernel-wide graph only needs to look at
+	// the dnodes that the substring index gives.
+	m_usesub = (m_flags & KB_GRAPH) && !(m_flags & KB_WHOLE_WORD) &&
+		   open_subindex(datafile);
+
+	// A binary graph can be searched in place, so only build the
+	// dnodemap if the symbol can actually be found in it. Part of a
+	// graph with type references is in the type store, so it is read
+	// whole. The graph of the server is already in the dnodemap.
+	if (!resident && m_kbg.open(datafile) && m_kbg.has_typerefs())
+		m_kbg.close();
+
+	if (m_kbg.is_open()) {
+
+		if (!probe_binmap()) {
+			m_kbg.close();
+			return (m_flags & KB_COUNT) ? put_count() : EXE_NOTFOUND;
+		}
+
+		// A whole word search only visits the dnodes it finds by
+		// crc, so those are decoded as they are looked up. So does
+		// a search of the dnodes given by the substring index.
+		if ((m_flags & KB_WHOLE_WORD) || m_usesub) {
+			m_dnmap.clear();
+			kb_set_lazy_graph(&m_kbg);
+		} else {
+			m_kbg.decode(m_dnmap);
+			m_kbg.close();
+		}
+
+	} else if(!resident && kb_read_dnodemap(datafile, m_dnmap) != 0)
+		return EXE_NOFILE;
+
+	status = exe_query();
+	kb_set_lazy_graph(NULL);
+	m_kbg.close();
+	return status;
+}
+
+/*****************************************************************************
+ * lookup::exe_query() - search the dnodemap as selected by switches e,s,c,d
+ */
+int lookup::exe_query()
+{
+	int status = 0;
+
+	switch (m_flags & m_exemask) {
+	case KB_STRUCT  : status = exe_struct();
+			  break;
+	case KB_EXPORTS : status = exe_exports();
+			  break;
+	case KB_DECL    : status = exe_decl();
+			  break;
+	case KB_COUNT   : status = exe_count();
+			  break;
+	}
+
+	return status;
+}
+
+/*****************************************************************************
+ * lookup::probe_binmap()
+ *
+ * Search the records of the binary graph in m_kbg for the symbol, without
+ * deserializing the graph. Returns true if the symbol could be there.
+ */
+bool lookup::probe_binmap()
+{
+	if (m_flags & KB_WHOLE_WORD)
+		return m_kbg.find(raw_crc32(m_declstr.c_str())) != NULL;
+
+	if (m_usesub)
+		return !m_subcrcs.empty();
+
+	for (size_t i = 0; i < m_kbg.size(); ++i) {
+		const kbdnrec& dr = m_kbg.dnrec(i);
+		const kbcnrec *cr = m_kbg.siblings(dr);
+
+		if (!(m_flags & KB_EXPORTS)) {
+			if (m_pattern.match(m_kbg.str(dr.decl)))
+				return true;
+			continue;
+		}
+
+		if (dr.sibcount && (cr->level == LVL_EXPORTED) &&
+		    m_pattern.match(m_kbg.str(cr->name)))
+			return true;
 	}
-	closedir(m_kbdir);
-	m_errindex = found ? EXE_OK : EXE_NO_WLIST;
-	return found;
+
+	return false;
 }
 
 /*****************************************************************************
- * lookup::report_nopath(const char *name, const char *path)
+ * lookup::open_subindex(string& datafile)
+ *
+ * Get the crcs of the dnodes that could have the substring from the index
+ * that kabi-merge writes next to the graph. Returns false if there is no
+ * index, if the graph has changed since it was made, or if the substring is
+ * too short for it, in which case every dnode must be searched.
  */
-void lookup::report_nopath(const char* name, const char* path)
+bool lookup::open_subindex(const string& datafile)
 {
-	cout << "\nCannot open " << path << ": " << name << endl;
-	exit(EXE_NOFILE);
+	kbsubkind kind = (m_flags & KB_EXPORTS) ? KB_SUB_EXPORT : KB_SUB_DECL;
+	bool found;
+
+	if (!m_kbsub.open(kb_get_subindex_name(datafile)))
+		return false;
+
+	found = m_kbsub.is_current(datafile) &&
+		m_kbsub.find(m_pattern.literal(), kind, m_subcrcs);
+	m_kbsub.close();
+	return found;
 }
 
 /*****************************************************************************
- * lookup::execute(string datafile)
+ * lookup::get_candidates(vector<crc_t>& crcs)
+ *
+ * Fill the crcs vector with the dnodes a substring search must look at, in
+ * crc order.
  */
-int lookup::execute(string datafile)
+void lookup::get_candidates(vector<crc_t>& crcs)
 {
-	if(kb_read_dnodemap(datafile, m_dnmap) != 0)
-		return EXE_NOFILE;
-
-	switch (m_flags & m_exemask) {
-	case KB_STRUCT  : return exe_struct();
-	case KB_EXPORTS : return exe_exports();
-	case KB_DECL    : return exe_decl();
-	case KB_COUNT   : return exe_count();
+	crcs.clear();
+
+	// The index is checked against the graph, but a damaged one must
+	// not give a dnode that is not there.
+	if (m_usesub) {
+		for (crc_t crc : m_subcrcs)
+			if (m_kbg.is_open() ? m_kbg.find(crc) != NULL
+					    : m_dnmap.count(crc) != 0)
+				crcs.push_back(crc);
+		return;
 	}
-	return 0;
+
+	crcs.reserve(m_dnmap.size());
+
+	for (auto& it : m_dnmap)
+		crcs.push_back(it.first);
 }
 
 /*****************************************************************************
@@ -440,7 +1577,7 @@ int lookup::execute(string datafile)
  */
 int lookup::exe_struct()
 {
-	bool quiet = m_flags & KB_QUIET;
+	vector<crc_t> crcs;
 
 	if (m_opts.kb_flags & KB_WHOLE_WORD) {
 		unsigned long crc = raw_crc32(m_declstr.c_str());
@@ -449,28 +1586,40 @@ int lookup::exe_struct()
 		if (!dn)
 			return EXE_NOTFOUND;
 
-		m_rowman.rows.clear();
-		get_siblings_up(*dn);
-		m_rowman.put_rows_from_back(quiet);
+		crcs.push_back(crc);
 
 	} else {
 
-		for (auto it : m_dnmap) {
-			dnode& dn = it.second;
+		vector<crc_t> candidates;
 
-			if (dn.decl.find(m_declstr) == string::npos)
-				continue;
+		get_candidates(candidates);
 
-			m_isfound = true;
-			m_rowman.rows.clear();
-			get_siblings_up(dn);
-			m_rowman.put_rows_from_back(quiet);
+		for (crc_t crc : candidates) {
+			dnode& dn = *kb_lookup_dnode(crc);
+
+			if (m_pattern.match(kb_str(dn.decl)))
+				crcs.push_back(crc);
 		}
 	}
 
+	put_by_file(crcs);
 	return m_isfound ? EXE_OK : EXE_NOTFOUND;
 }
 
+/*****************************************************************************
+ * lookup::put_struct(dnode& dn)
+ *
+ * Print the hierarchy above every instance of the dnode in the file.
+ */
+void lookup::put_struct(dnode& dn)
+{
+	bool quiet = m_flags & KB_QUIET;
+
+	m_rowman.rows.clear();
+	get_siblings_up(dn);
+	m_rowman.put_rows_from_back(quiet);
+}
+
 /*****************************************************************************
  * int lookup::exe_exports()
  *
@@ -482,8 +1631,7 @@ int lookup::exe_struct()
  */
 int lookup::exe_exports()
 {
-	bool quiet = m_flags & KB_QUIET;
-	int status = EXE_OK;
+	vector<crc_t> crcs;
 
 	if (m_opts.kb_flags & KB_WHOLE_WORD) {
 		unsigned long crc = raw_crc32(m_declstr.c_str());
@@ -495,39 +1643,50 @@ int lookup::exe_exports()
 		if ((m_flags & KB_WHITE_LIST) && !(is_whitelisted(m_declstr)))
 			return EXE_NOTWHITE;
 
-		m_isfound = true;
-		m_rowman.rows.clear();
-		get_file_of_export(*dn);
-		status = get_siblings_exported(*dn);
-
-		if (status == EXE_OK)
-			m_rowman.put_rows_from_front(quiet);
+		crcs.push_back(crc);
 
 	} else {
 
-		for (auto it : m_dnmap) {
-			dnode& dn = it.second;
+		vector<crc_t> candidates;
 
-			cniterator cnit = dn.siblings.begin();
-			cnode cn = cnit->second;
+		get_candidates(candidates);
 
-			if ((cn.level != LVL_EXPORTED) ||
-			    (cn.name.find(m_declstr) == string::npos))
-				continue;
+		for (crc_t crc : candidates) {
+			dnode& dn = *kb_lookup_dnode(crc);
 
-			m_isfound = true;
-			m_rowman.rows.clear();
-			get_file_of_export(dn);
-			status = get_siblings_exported(dn);
+			const cnode& cn = dn.siblings.begin()->second;
 
-			if (status == EXE_OK)
-				m_rowman.put_rows_from_front(quiet);
+			if ((cn.level == LVL_EXPORTED) &&
+			    m_pattern.match(kb_str(cn.name)))
+				crcs.push_back(crc);
 		}
 	}
 
+	put_by_file(crcs);
 	return m_isfound ? EXE_OK : EXE_NOTFOUND;
 }
 
+/*****************************************************************************
+ * lookup::put_exports(dnode& dn)
+ *
+ * Print the file, and each export in the file with its arguments.
+ */
+void lookup::put_exports(dnode& dn)
+{
+	bool quiet = m_flags & KB_QUIET;
+	const cnode* cnp = get_first_sibling(dn);
+
+	if (!cnp || (cnp->level != LVL_EXPORTED))
+		return;
+
+	m_isfound = true;
+	m_rowman.rows.clear();
+	get_file_of_export(*cnp);
+
+	if (get_siblings_exported(dn) == EXE_OK)
+		m_rowman.put_rows_from_front(quiet);
+}
+
 /*****************************************************************************
  * lookout::exe_decl()
  *
@@ -539,7 +1698,7 @@ int lookup::exe_exports()
  */
 int lookup::exe_decl()
 {
-	bool quiet = m_flags & KB_QUIET;
+	vector<crc_t> crcs;
 
 	if (m_opts.kb_flags & KB_WHOLE_WORD) {
 		unsigned long crc = raw_crc32(m_declstr.c_str());
@@ -548,37 +1707,92 @@ int lookup::exe_decl()
 		if (!dn)
 			return EXE_NOTFOUND;
 
-		cniterator cnit = dn->siblings.begin();
-		cnode cn = cnit->second;
-		m_isfound = true;
-		m_rowman.rows.clear();
-		m_rowman.fill_row(*dn, cn);
-
-		get_children(*dn, cn);
-		m_rowman.put_rows_from_front_normalized(quiet);
+		crcs.push_back(crc);
 
 	} else {
 
-		for (auto it : m_dnmap) {
-			dnode& dn = it.second;
-			cniterator cnit = dn.siblings.begin();
-			cnode cn = cnit->second;
+		vector<crc_t> candidates;
 
-			if (dn.decl.find(m_declstr) == string::npos)
-				continue;
+		get_candidates(candidates);
 
-			m_isfound = true;
-			m_rowman.rows.clear();
-			m_rowman.fill_row(dn, cn);
+		for (crc_t crc : candidates) {
+			dnode& dn = *kb_lookup_dnode(crc);
 
-			get_children(dn, cn);
-			m_rowman.put_rows_from_front_normalized(quiet);
+			if (m_pattern.match(kb_str(dn.decl)))
+				crcs.push_back(crc);
 		}
 	}
 
+	put_by_file(crcs);
 	return m_isfound ? EXE_OK : EXE_NOTFOUND;
 }
 
+/*****************************************************************************
+ * lookup::put_decl(dnode& dn)
+ *
+ * Print the first instance of the dnode in the file with its members.
+ */
+void lookup::put_decl(dnode& dn)
+{
+	bool quiet = m_flags & KB_QUIET;
+	const cnode* cnp = get_first_sibling(dn);
+
+	if (!cnp)
+		return;
+
+	m_isfound = true;
+	m_rowman.rows.clear();
+	m_rowman.fill_row(dn, *cnp);
+
+	get_children(dn, *cnp);
+	m_rowman.put_rows_from_front_normalized(quiet);
+}
+
+/*****************************************************************************
+ * lookup::put_by_file(const vector<crc_t>& crcs)
+ *
+ * Print what was found in the dnodes. A kernel-wide graph prints the results
+ * of each file together, and the files in the order of the file list, as
+ * they would be printed if the files were searched one at a time. Each file
+ * is searched afresh, and the search stops at the same file as it would
+ * there.
+ */
+void lookup::put_by_file(const vector<crc_t>& crcs)
+{
+	vector<pair<crc_t, vector<crc_t> > > files;
+
+	get_files(crcs, files);
+
+	for (auto& file : files) {
+		set_file(file.first);
+		m_dups.clear();
+		m_rowman.reset();
+
+		for (crc_t crc : file.second) {
+			dnode& dn = *kb_lookup_dnode(crc);
+
+			switch (m_flags & m_exemask) {
+			case KB_STRUCT  : put_struct(dn);
+					  break;
+			case KB_EXPORTS : put_exports(dn);
+					  break;
+			case KB_DECL    : put_decl(dn);
+					  break;
+			}
+		}
+
+		if (m_isfound && (m_flags & KB_WHOLE_WORD)
+			      && ((m_flags & KB_EXPORTS)
+			      ||  (m_flags & KB_DECL)))
+			break;
+
+		if (m_isfound && (m_flags & KB_JUSTONE))
+			break;
+	}
+
+	set_file(0);
+}
+
 /*****************************************************************************
  * lookup::exe_count() - count the appearances of the symbol in provided scope
  *
@@ -591,15 +1805,68 @@ int lookup::exe_count()
 	if (m_opts.kb_flags & KB_WHOLE_WORD) {
 		m_crc = raw_crc32(m_declstr.c_str());
 		dnode* dn = kb_lookup_dnode(m_crc);
-		m_count += dn ? dn->siblings.size() : 0;
+		m_count += dn ? count_siblings(*dn) : 0;
 	} else {
-		for (auto it : m_dnmap) {
-			dnode& dn = it.second;
-			if (dn.decl.find(m_declstr) != string::npos)
-				++m_count;
+		vector<crc_t> crcs;
+
+		get_candidates(crcs);
+
+		for (crc_t crc : crcs) {
+			dnode& dn = *kb_lookup_dnode(crc);
+			if (m_pattern.match(kb_str(dn.decl)))
+				m_count += count_files(dn);
 		}
 	}
 
+	return put_count();
+}
+
+/*****************************************************************************
+ * lookup::exe_list() - list the exports of the files or modules in scope
+ *
+ * The scope in m_declstr is matched against the source file and the module
+ * of each export in the catalog, as a substring, a whole word or a pattern.
+ * Each export is printed with its source file, its module, and the crc of
+ * its signature, in the order of their names.
+ */
+int lookup::exe_list()
+{
+	string filelist = m_kabidir + m_filelist;
+	bool whole = m_flags & KB_WHOLE_WORD;
+
+	if (!open_catalog(filelist)) {
+		m_errvec.push_back(kb_get_catalog_name(filelist));
+		m_errvec.push_back("Run kabi-index to make it");
+		return EXE_NOFILE;
+	}
+
+	for (size_t i = 0; i < m_kbcat.count(); ++i) {
+		const kbcatrec& cr = m_kbcat.rec(i);
+		const char *source = m_kbcat.str(cr.source);
+		const char *module = m_kbcat.str(cr.module);
+
+		if (whole ? (m_declstr != source) && (m_declstr != module)
+			  : !m_pattern.match(source) && !m_pattern.match(module))
+			continue;
+
+		m_isfound = true;
+		cout << format("%-40s %-40s %-24s %08x\n")
+			% m_kbcat.str(cr.name) % source
+			% (*module ? module : "-") % cr.signature;
+
+		if (m_flags & KB_JUSTONE)
+			break;
+	}
+
+	m_kbcat.close();
+	return m_isfound ? EXE_OK : EXE_NOTFOUND;
+}
+
+/*****************************************************************************
+ * lookup::put_count() - report the running count on stderr
+ */
+int lookup::put_count()
+{
 	cerr << "\33[2K\r";
 	cerr << m_count;
 	//cerr.flush();
@@ -607,22 +1874,175 @@ int lookup::exe_count()
 }
 
 /*****************************************************************************
- * lookup::is_whitelisted(string &ksym)
+ * lookup::is_masked(const cnode& cn)
  *
- * Search the m_whitelist vector for a matching symbol.
+ * When searching a kernel-wide graph, the -m mask is applied to the file
+ * from which each cnode came, rather than to the name of the data file.
+ * Returns true if the cnode should be skipped.
  */
-bool lookup::is_whitelisted(string& ksym)
+bool lookup::is_masked(const cnode& cn)
 {
-	bool found;
-	vector<string>::iterator vit;
+	if (m_file && (cn.file != m_file))
+		return true;
 
-	vit = find_if(m_whitelist.begin(), m_whitelist.end(),
-		[ksym](string& str) {
-			return (str == ksym);
-		});
+	if (!(m_flags & KB_GRAPH) || !(m_flags & KB_MASKSTR))
+		return false;
 
-	found = vit != m_whitelist.end();
-	return found;
+	dnode* file = kb_lookup_dnode(cn.file);
+	return !file || (kb_str(file->decl).find(m_maskstr) == string::npos);
+}
+
+/*****************************************************************************
+ * lookup::get_first_sibling(const dnode& dn)
+ *
+ * Returns the first sibling that is not masked, or NULL if there is none.
+ */
+const cnode* lookup::get_first_sibling(const dnode& dn)
+{
+	for (auto it = file_siblings(dn); in_file(dn, it); ++it)
+		if (!is_masked(it->second))
+			return &it->second;
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * lookup::set_file(crc_t file)
+ *
+ * Limit a kernel-wide graph to the file, or to no file if it is zero. The
+ * orders of each file follow those of the file before it, starting with
+ * the order of the cnode of the file itself, so the siblings and children
+ * of a dnode from one file are together.
+ */
+void lookup::set_file(crc_t file)
+{
+	m_file = file;
+	m_filebase = get_file_base(file);
+}
+
+/*****************************************************************************
+ * lookup::get_file_base(crc_t file)
+ *
+ * Returns the order of the cnode of the file, or zero if it is not known.
+ */
+int lookup::get_file_base(crc_t file)
+{
+	const dnode* dn = file ? kb_lookup_dnode(file) : NULL;
+
+	return (dn && !dn->siblings.empty()) ? dn->siblings.begin()->first : 0;
+}
+
+/*****************************************************************************
+ * lookup::file_siblings(const dnode& dn)
+ * lookup::in_file(const dnode& dn, cnodemap::const_iterator it)
+ *
+ * Walk the siblings of the dnode from the file set by set_file(), or all of
+ * them.
+ */
+cnodemap::const_iterator lookup::file_siblings(const dnode& dn)
+{
+	return m_file ? dn.siblings.lower_bound(m_filebase)
+		      : dn.siblings.begin();
+}
+
+bool lookup::in_file(const dnode& dn, cnodemap::const_iterator it)
+{
+	return (it != dn.siblings.end()) &&
+	       (!m_file || (it->second.file == m_file));
+}
+
+/*****************************************************************************
+ * lookup::get_files(const vector<crc_t>& crcs, files)
+ *
+ * List the files in which the dnodes appear, in the order of the file list,
+ * each with the dnodes that appear in it, in the order of crcs. The graph of
+ * a single file gets one file of zero, which is not a filter.
+ */
+void lookup::get_files(const vector<crc_t>& crcs,
+		       vector<pair<crc_t, vector<crc_t> > >& files)
+{
+	map<crc_t, vector<crc_t> > dnodes;
+	set<pair<int, crc_t> > bases;
+
+	files.clear();
+
+	if (!(m_flags & KB_GRAPH)) {
+		files.push_back(make_pair(0, crcs));
+		return;
+	}
+
+	for (crc_t crc : crcs) {
+		dnode& dn = *kb_lookup_dnode(crc);
+
+		for (auto& it : dn.siblings) {
+			cnode& cn = it.second;
+
+			if (is_masked(cn))
+				continue;
+
+			vector<crc_t>& incrcs = dnodes[cn.file];
+
+			if (incrcs.empty())
+				bases.insert(make_pair(get_file_base(cn.file),
+						       cn.file));
+
+			if (incrcs.empty() || (incrcs.back() != crc))
+				incrcs.push_back(crc);
+		}
+	}
+
+	for (auto& base : bases)
+		files.push_back(make_pair(base.second, dnodes[base.second]));
+}
+
+/*****************************************************************************
+ * lookup::count_siblings(dnode& dn)
+ *
+ * Count the instances of the dnode that are not masked.
+ */
+int lookup::count_siblings(dnode& dn)
+{
+	int count = 0;
+
+	if (!(m_flags & KB_GRAPH))
+		return dn.siblings.size();
+
+	for (auto& it : dn.siblings)
+		count += is_masked(it.second) ? 0 : 1;
+
+	return count;
+}
+
+/*****************************************************************************
+ * lookup::count_files(dnode& dn)
+ *
+ * Count the files in which the dnode appears. That is always one for the
+ * graph of a single file. A kernel-wide graph has each dnode only once, so
+ * count the distinct files of its siblings to get the same total as a
+ * search of the individual data files.
+ */
+int lookup::count_files(dnode& dn)
+{
+	set<crc_t> files;
+
+	if (!(m_flags & KB_GRAPH))
+		return 1;
+
+	for (auto& it : dn.siblings)
+		if (!is_masked(it.second))
+			files.insert(it.second.file);
+
+	return files.size();
+}
+
+/*****************************************************************************
+ * lookup::is_whitelisted(string &ksym)
+ *
+ * Look the symbol up in the hash table of the white lists.
+ */
+bool lookup::is_whitelisted(const string& ksym)
+{
+	return m_white->has(ksym);
 }
 
 /*****************************************************************************
@@ -632,16 +2052,16 @@ bool lookup::is_whitelisted(string& ksym)
  * and search the whitelist for a match.
  *
  */
-bool lookup::is_function_whitelisted(cnode& cn)
+bool lookup::is_function_whitelisted(const cnode& cn)
 {
 	dnode* func = kb_lookup_dnode(cn.function);
 	if (!func) return false;
 	cnode& fcn = func->siblings.begin()->second;
-	return is_whitelisted(fcn.name);
+	return is_whitelisted(kb_str(fcn.name));
 }
 
 /*****************************************************************************
- * lookup::get_parents(cnode &cn)
+ * lookup::get_parents(const cnode& cn)
  *
  * Lookup the parent's dnode using the crc from the parent field of the
  * cnode passed as an arg.
@@ -650,34 +2070,38 @@ bool lookup::is_function_whitelisted(cnode& cn)
  * the same ancestry as the cnode that was passed as an argument and is
  * one level up from the cnode passed as an argument.
  *
- * Do this recursively, until we either run out of siblings or we've
- * reached the top of the hierarchy, so that the crc is zero.
+ * Repeat from the parent that was found, until we either run out of
+ * siblings or we've reached the top of the hierarchy, so that the crc is
+ * zero. The cnodes are not copied, each step only holds a pointer to the
+ * one it came from. In a kernel-wide graph, the parent must also come from
+ * the same file.
  *
  */
-int lookup::get_parents(cnode& cn)
+int lookup::get_parents(const cnode& cn)
 {
-	crc_t crc = cn.parent.second;
+	const cnode *ccn = &cn;
 
-	if (!crc)
-		return EXE_OK;
+	while (crc_t crc = ccn->parent.second) {
+		const dnode* parentdn = kb_lookup_dnode(crc);
 
-	dnode parentdn = *kb_lookup_dnode(crc);
-	cnodemap siblings = parentdn.siblings;
-	cniterator cnit;
+		if (!parentdn)
+			break;
+
+		auto cnit = find_if(parentdn->siblings.begin(),
+				    parentdn->siblings.end(),
+			[ccn](const cnpair& lcnp) {
+				return kb_is_adjacent(*ccn, lcnp.second,
+						      SK_PARENT) &&
+				       (lcnp.second.file == ccn->file);
+			});
 
-	cnit = find_if(siblings.begin(), siblings.end(),
-		[cn](cnpair& lcnp) {
-			cnode lcn = lcnp.second;
-			cnode ccn = cn;
-			return kb_is_adjacent(ccn, lcn, SK_PARENT);
-		});
+		if (cnit == parentdn->siblings.end())
+			break;
 
-	if (cnit == siblings.end())
-		return EXE_OK;
+		m_rowman.fill_row(*parentdn, cnit->second);
+		ccn = &cnit->second;
+	}
 
-	cnode parentcn = cnit->second;
-	m_rowman.fill_row(parentdn, parentcn);
-	this->get_parents(parentcn);
 	return EXE_OK;
 }
 
@@ -691,15 +2115,18 @@ int lookup::get_parents(cnode& cn)
  * whitelisted, then skip it.
  *
  */
-int lookup::get_siblings_up(dnode& dn)
+int lookup::get_siblings_up(const dnode& dn)
 {
-	for (auto it : dn.siblings) {
-		cnode cn = it.second;
+	for (auto it = file_siblings(dn); in_file(dn, it); ++it) {
+		const cnode& cn = it->second;
 
 		if ((m_flags & KB_WHITE_LIST) &&
 		   !(is_function_whitelisted(cn)))
 			continue;
 
+		if (is_masked(cn))
+			continue;
+
 		m_isfound = true;
 		m_rowman.fill_row(dn, cn);
 
@@ -713,62 +2140,165 @@ int lookup::get_siblings_up(dnode& dn)
 /*****************************************************************************
  * lookup::is_dup(crc_t crc)
  *
- * Check the m_dups vector for this crc. Return true if we've seen it before.
+ * Check the m_dups set for this crc. Return true if we've seen it before.
  */
 bool lookup::is_dup(crc_t crc)
 {
-	vector<crc_t>::iterator it;
-
-	it = find_if (m_dups.begin(), m_dups.end(),
-		[crc](crc_t lcrc)
-		{
-			return lcrc == crc;
-		});
-
-	return (it == m_dups.end()) ? false : true;
+	return m_dups.count(crc) != 0;
 }
 
 /*****************************************************************************
- * lookup::get_children(dnode& pdn, cnode& pcn)
+ * lookup::get_children(const dnode& pdn, const cnode& pcn)
  *
  * pdn - parent dnode
  * pcn - parent cnode
  *
  * Given a reference to a dnode, walk the dnode's children crcmap and gather
- * the info on the children. This is done reursively, until we've parsed all
- * the children and all their descendants.
+ * the info on the children, and on all their descendants, depth first.
+ *
+ * The walk keeps its own stack of the dnodes on the way down in m_stack,
+ * rather than recursing, so a deep hierarchy cannot overflow the call
+ * stack. The stack holds one frame for each level, and the dnodes are
+ * visited in place. Only the cnode of the child being visited is copied,
+ * to correct its level.
+ *
+ * A dnode is expanded only the first time it is seen in the branch of each
+ * argument or return, which m_dups keeps track of. Its later instances in
+ * the branch are printed without their descendants. With --max-depth, the
+ * walk stops that many levels below the parent.
+ *
+ * Only the children from the file of the cnode being expanded are visited,
+ * see first_child().
  */
-int lookup::get_children(dnode& pdn, cnode& pcn)
+int lookup::get_children(const dnode& pdn, const cnode& pcn)
 {
-	for (auto i : pdn.children) {
-		int order = i.first;
-		crc_t crc = i.second;
-		dnode cdn = *kb_lookup_dnode(crc);	// child dnode
-		cnodemap siblings = cdn.siblings;
-		cnode ccn = siblings[order];
+	crc_t file = pcn.file;
+	int base = get_file_base(file);
+	crc_t from;
+	auto first = first_child(pdn, file, base, from);
+
+	m_stack.clear();
+	m_stack.push_back({&pdn, first, from, pcn.level});
+
+	while (!m_stack.empty()) {
+		kbframe& top = m_stack.back();
+
+		if (top.next == top.dn->children.end()) {
+			m_stack.pop_back();
+			continue;
+		}
+
+		int order = top.next->first;
+		crc_t crc = top.next->second;
+		int level = top.level + 1;
+		++top.next;
+
+		const dnode* cdn = kb_lookup_dnode(crc);	// child dnode
+
+		if (!cdn)
+			continue;
+
+		auto cnit = cdn->siblings.find(order);
+		cnode ccn = cnit != cdn->siblings.end() ? cnit->second : cnode();
+
+		// The children from the file end at the first from another.
+		if (top.file && ccn.file && (ccn.file != top.file)) {
+			m_stack.pop_back();
+			continue;
+		}
 
 		// Backpointers and dups are "virtualized", that is, there
 		// is only one cnode for all. In those cases, the level
 		// field is only correct for the first one encountered.
 		// To assure that we have the correct level, simply set
 		// it to parent cnode level + 1.
-		ccn.level = pcn.level + 1;
+		ccn.level = level;
 
-		if (ccn.level <= LVL_ARG)
+		if ((ccn.level <= LVL_ARG) && !m_dups.empty())
 			m_dups.clear();
 
-		m_rowman.fill_row(cdn, ccn);
+		m_rowman.fill_row(*cdn, ccn);
 		DBG(m_rowman.print_row(m_rowman.rows.back());)
 
 		if ((is_dup(crc)) || (ccn.flags & CTL_BACKPTR))
 			continue;
 
-		m_dups.push_back(crc);
-		get_children(cdn, ccn);
+		if (m_opts.maxdepth && ((int)m_stack.size() >= m_opts.maxdepth))
+			continue;
+
+		if (ccn.file != file) {
+			file = ccn.file;
+			base = get_file_base(file);
+		}
+
+		m_dups.insert(crc);
+		first = first_child(*cdn, file, base, from);
+		m_stack.push_back({cdn, first, from, level});
 	}
+
 	return EXE_OK;
 }
 
+/*****************************************************************************
+ * lookup::first_child(const dnode& dn, crc_t file, int base, crc_t& from)
+ *
+ * dn   - dnode whose children are to be visited
+ * file - file of the instance of the dnode, or zero if not known
+ * base - order of the cnode of the file, see set_file()
+ * from - set to the file the children come from
+ *
+ * kabi-parser only records the children of a dnode under its first instance
+ * in a graph, and the later instances share them. A kernel-wide graph keeps
+ * the children from each graph that was merged into it, so a struct that is
+ * defined differently by different files has the members of each. They are
+ * together for each file, in the order of the file list.
+ *
+ * Returns the first of the children from the file. If there are none, the
+ * file was in the graph of an earlier one, and shares the children of the
+ * nearest file before it that has any.
+ */
+crcnodemap::const_iterator lookup::first_child(const dnode& dn, crc_t file,
+					       int base, crc_t& from)
+{
+	const crcnodemap& kids = dn.children;
+	auto it = kids.lower_bound(base);
+
+	from = 0;
+
+	if (!file || (it == kids.end() && it == kids.begin()))
+		return kids.begin();
+
+	if (it != kids.end()) {
+		from = get_child_file(*it);
+
+		if ((from == file) || (it == kids.begin()))
+			return it;
+	}
+
+	from = get_child_file(*--it);
+
+	while ((it != kids.begin()) && (get_child_file(*prev(it)) == from))
+		--it;
+
+	return it;
+}
+
+/*****************************************************************************
+ * lookup::get_child_file(const crcpair& child)
+ *
+ * Returns the file of the cnode of the child, or zero if it is not known.
+ */
+crc_t lookup::get_child_file(const crcpair& child)
+{
+	const dnode* dn = kb_lookup_dnode(child.second);
+
+	if (!dn)
+		return 0;
+
+	auto cnit = dn->siblings.find(child.first);
+	return cnit != dn->siblings.end() ? cnit->second.file : 0;
+}
+
 /*****************************************************************************
  * lookup::get_siblings(dnode& dn)
  * dn - reference to a dnode
@@ -776,10 +2306,10 @@ int lookup::get_children(dnode& pdn, cnode& pcn)
  * Walk the siblings cnodemap in the dnode to access each instance of the
  * symbol characterized by the dnode.
  */
-int lookup::get_siblings(dnode& dn)
+int lookup::get_siblings(const dnode& dn)
 {
-	for (auto it : dn.siblings) {
-		cnode cn = it.second;
+	for (auto& it : dn.siblings) {
+		const cnode& cn = it.second;
 		m_rowman.fill_row(dn, cn);
 		DBG(m_rowman.print_row(m_rowman.rows.back());)
 		get_children(dn, cn);
@@ -794,13 +2324,13 @@ int lookup::get_siblings(dnode& dn)
  * Walk the siblings cnodemap in the dnode to access each instance of the
  * symbol characterized by the dnode.
  */
-int lookup::get_siblings_exported(dnode& dn)
+int lookup::get_siblings_exported(const dnode& dn)
 {
 	bool found = false;
-	for (auto it : dn.siblings) {
-		cnode cn = it.second;
+	for (auto it = file_siblings(dn); in_file(dn, it); ++it) {
+		const cnode& cn = it->second;
 
-		if (!(cn.flags & CTL_EXPORTED))
+		if (!(cn.flags & CTL_EXPORTED) || is_masked(cn))
 			continue;
 
 		m_rowman.fill_row(dn, cn);
@@ -812,25 +2342,26 @@ int lookup::get_siblings_exported(dnode& dn)
 }
 
 /*****************************************************************************
- * lookup::get_file_of_export(dnode &dn)
+ * lookup::get_file_of_export(const cnode& cn)
  *
  * Gets the name of the file that has the exported function characterized
- * by the dnode argument.
+ * by the cnode argument.
  *
  */
-int lookup::get_file_of_export(dnode &dn)
+int lookup::get_file_of_export(const cnode& cn)
 {
-	auto it = dn.siblings.cbegin();
-	cnode cn = it->second;
 	crc_t crc = cn.parent.second;
 
 	if (!crc)
 		return EXE_NOTFOUND;
 
-	dnode parentdn = *kb_lookup_dnode(crc);
-	it = parentdn.siblings.begin();
-	cnode parentcn = it->second;
-	m_rowman.fill_row(parentdn, parentcn);
+	const dnode* parentdn = kb_lookup_dnode(crc);
+
+	if (!parentdn || parentdn->siblings.empty())
+		return EXE_NOTFOUND;
+
+	const cnode& parentcn = parentdn->siblings.cbegin()->second;
+	m_rowman.fill_row(*parentdn, parentcn);
 	DBG(m_rowman.print_row(m_rowman.rows.back());)
 
 	return EXE_OK;
@@ -23,10 +23,16 @@
 #define KABILOOKUP_H
 
 #include <map>
+#include <set>
 #include <vector>
+#include <unordered_set>
+#include <sstream>
 #include <dirent.h>
 #include "kabi-map.h"
+#include "kabi-bin.h"
+#include "kabi-index.h"
 #include "options.h"
+#include "pattern.h"
 #include "error.h"
 #include "rowman.h"
 
@@ -42,29 +48,98 @@ private:
 	int process_args(int argc, char **argv);
 	bool check_flags();
 	int count_bits(unsigned mask);
-	int get_parents(cnode &cn);
-	int get_children(dnode& pdn, cnode &pcn);
-	int get_siblings(dnode& dn);
-	int get_siblings_up(dnode& dn);
-	int get_siblings_exported(dnode& dn);
+	int get_parents(const cnode& cn);
+	int get_children(const dnode& pdn, const cnode& pcn);
+	crcnodemap::const_iterator first_child(const dnode& dn, crc_t file,
+					       int base, crc_t& from);
+	crc_t get_child_file(const crcpair& child);
+	int get_siblings(const dnode& dn);
+	int get_siblings_up(const dnode& dn);
+	int get_siblings_exported(const dnode& dn);
 	int execute(std::string datafile);
+	int exe_query();
+	bool read_batch();
+	int run_batch(std::istream& datafiles);
+	void run_jobs();
+	void run_worker(const std::vector<size_t>& work, size_t first,
+			size_t step, int fd);
+	int serve();
+	int serve_query(int fd);
+	int query_server();
+	bool is_resident(const std::string& datafile);
+	bool probe_binmap();
+	bool open_subindex(const std::string& datafile);
+	void get_candidates(std::vector<crc_t>& crcs);
+	void open_index();
+	bool open_catalog(const std::string& catfile);
+	void get_catalog_files();
+	int exe_list();
+	bool is_indexed(size_t filenum);
+	bool is_reach_whitelisted();
 	int exe_count();
+	int put_count();
 	int exe_struct();
+	void put_struct(dnode& dn);
 	int exe_exports();
+	void put_exports(dnode& dn);
 	int exe_decl();
-	int get_file_of_export(dnode& dn);
+	void put_decl(dnode& dn);
+	void put_by_file(const std::vector<crc_t>& crcs);
+	int get_file_of_export(const cnode& cn);
 	int set_working_directory();
 	int set_start_directory()	;
 	void report_nopath(const char *name, const char *path);
 	void assure_trailing_slash(std::string& dirspec);
 	bool is_dup(crc_t crc);
-	bool is_whitelisted(std::string& ksym);
-	bool is_function_whitelisted(cnode& cn);
+	bool is_masked(const cnode& cn);
+	const cnode* get_first_sibling(const dnode& dn);
+	void set_file(crc_t file);
+	int get_file_base(crc_t file);
+	cnodemap::const_iterator file_siblings(const dnode& dn);
+	bool in_file(const dnode& dn, cnodemap::const_iterator it);
+	int count_siblings(dnode& dn);
+	int count_files(dnode& dn);
+	void get_files(const std::vector<crc_t>& crcs,
+		       std::vector<std::pair<crc_t,
+					     std::vector<crc_t> > >& files);
+	bool is_whitelisted(const std::string& ksym);
+	bool is_function_whitelisted(const cnode& cn);
 	bool build_whitelist();
 	bool check_whitelist();
 
+	// A query read by read_batch(). Each query is a lookup of its own, so
+	// that it keeps its own flags, results and duplicates.
+	struct kbquery {
+		std::string line;
+		std::vector<std::string> args;
+		std::vector<char *> argv;
+		lookup *lu = NULL;
+		std::ostringstream out;
+		bool done = false;	// no need to search any more files
+		bool failed = false;	// stopped before the search
+		~kbquery() { delete lu; }
+	};
+
+	// A dnode on the way down in get_children(), with the next of its
+	// children to visit, the file they come from, and the level of the
+	// cnode it was reached by.
+	struct kbframe {
+		const dnode *dn;
+		crcnodemap::const_iterator next;
+		crc_t file;
+		int level;
+	};
+
 	// member classes
 	dnodemap& m_dnmap = kb_get_public_dnodemap();
+	kbgraph m_kbg;
+	kbindex m_kbidx;
+	kbcatalog m_kbcat;
+	kbbloom m_kbblm;
+	kbreach m_kbrch;
+	kbsubindex m_kbsub;
+	kbwhitelist m_kbwhite;
+	pattern m_pattern;
 	rowman m_rowman;
 	options m_opts;
 	error m_err;
@@ -73,14 +148,29 @@ private:
 	typedef std::pair<int, std::string> errpair;
 
 	//std::vector<errpair> m_errors;
-	std::vector<crc_t> m_dups;
-	std::vector<std::string> m_whitelist;
+	std::unordered_set<crc_t> m_dups;	// see get_children()
+	std::vector<kbframe> m_stack;
+	std::vector<uint32_t> m_idxfiles;	// indexed files with the symbol
+	std::vector<uint32_t> m_catfiles;	// files that export the symbol
+	std::vector<uint32_t> m_rchfiles;	// files where exports reach it
+	std::vector<uint32_t> m_rchexports;	// exports that reach it
+	std::vector<crc_t> m_subcrcs;		// dnodes with every trigram
+	// The white list of a batch query is the one of the batch.
+	const kbwhitelist *m_white = &m_kbwhite;
 	std::vector<std::string> m_errvec;
 
+	// The data files for run_jobs(), in file list order. The bool is
+	// false if the index says the file does not have the symbol.
+	std::vector<std::pair<std::string, bool> > m_jobs;
+
+	std::vector<kbquery *> m_batch;		// see read_batch()
+
 	std::string m_declstr;
+	crc_t m_declcrc = 0;
 	std::string m_maskstr;
 	std::string m_datafile = "../kabi-data.dat";
 	std::string m_filelist = "kabi-datafiles.list";
+	std::string m_resident;		// the graph kept by serve()
 
 	std::string m_startdir;
 	std::string m_userdir;
@@ -88,11 +178,16 @@ private:
 	DIR *m_kbdir;
 
 	crc_t m_crc;
+	crc_t m_file = 0;		// limits a kernel-wide graph to one file
+	int m_filebase = 0;		// order of the cnode of m_file
 	bool m_isfound = false;
+	bool m_usesub = false;		// search only m_subcrcs
 	int m_count = 0;
 	int m_flags = KB_QUIET;
 	int m_errindex = 0;
-	int m_exemask  = KB_COUNT | KB_DECL | KB_EXPORTS | KB_STRUCT;
+	int m_argc = 0;
+	char **m_argv = NULL;
+	int m_exemask  = KB_COUNT | KB_DECL | KB_EXPORTS | KB_STRUCT | KB_LIST;
 };
 
 #endif // KABILOOKUP_H
@@ -0,0 +1,161 @@
+/* kabimerge.cpp - class to merge the graph files created by kabi-parser
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * kabi-parser leaves one graph file next to each object file, and common
+ * types appear in thousands of them. This utility folds every graph file
+ * in the file list into one kernel-wide graph that kabi-lookup can search
+ * with a single load.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "kabimerge.h"
+#include "kabi-index.h"
+
+using namespace std;
+
+string kabimerge::get_helptext()
+{
+	return "\
+kabi-merge [-tzq] [-f file-list] [-o graph] [-p path]\n\
+    Merges the graph files in the file list into one kernel-wide graph\n\
+    that can be searched with \"kabi-lookup -g graph\". Each data type is\n\
+    stored only once, and each instance of it remembers its source file.\n\
+    A trigram index of the type and symbol names is written beside the\n\
+    graph, with the extension .sub, so that substring searches with -g\n\
+    only need to look at the dnodes that can match.\n\
+\n\
+    -f filelist - List of graph files created by kabi-parser. The default\n\
+                  is redhat/kabi/kabi-datafiles.list\n\
+    -o graph    - The merged graph. The default is\n\
+                  redhat/kabi/kabi-data.kbg\n\
+    -p path     - Path to top of kernel tree, if operating in a different\n\
+                  directory.\n\
+    -t          - Write a boost text archive instead of the binary format.\n\
+    -z          - Compress the graph with zstd.\n\
+    -q          - Do not show progress.\n\
+    -h          - this help message.\n";
+}
+
+/************************************************
+** main()
+************************************************/
+int main(int argc, char **argv)
+{
+	kabimerge km(argc, argv);
+	return km.run();
+}
+
+kabimerge::kabimerge(int argc, char **argv)
+{
+	if (process_args(argc, argv)) {
+		cout << get_helptext();
+		exit(1);
+	}
+}
+
+int kabimerge::process_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:o:p:tzqh")) != -1) {
+		switch (opt) {
+		case 'f' : m_filelist = optarg;
+			   break;
+		case 'o' : m_outfile = optarg;
+			   break;
+		case 'p' : m_userdir = optarg;
+			   break;
+		case 't' : m_text = true;
+			   break;
+		case 'z' : m_zstd = true;
+			   break;
+		case 'q' : m_quiet = true;
+			   break;
+		case 'h' : cout << get_helptext();
+			   exit(0);
+		default  : return -1;
+		}
+	}
+
+	return optind < argc ? -1 : 0;
+}
+
+int kabimerge::run()
+{
+	ifstream ifs;
+	string datafile;
+	int base = 0;
+	int count = 0;
+
+	if (!m_userdir.empty() && chdir(m_userdir.c_str())) {
+		cout << "Cannot access directory: " << m_userdir << endl;
+		return 1;
+	}
+
+	ifs.open(m_filelist);
+
+	if (!ifs.is_open()) {
+		cout << "Cannot open file: " << m_filelist << endl;
+		return 1;
+	}
+
+	while (getline(ifs, datafile)) {
+
+		if (!m_quiet)
+			cerr << "\33[2K\r" << datafile;
+
+		if (kb_read_dnodemap(datafile, m_filemap) != 0)
+			continue;
+
+		base = kb_merge_dnodemap(m_dnmap, m_filemap, base);
+
+		if (base < 0) {
+			cerr << "\33[2K\r";
+			cout << "Too many nodes to merge at: " << datafile << endl;
+			return 1;
+		}
+
+		++count;
+	}
+
+	ifs.close();
+
+	if (!m_quiet)
+		cerr << "\33[2K\r" << count << " files, "
+		     << m_dnmap.size() << " dnodes" << endl;
+
+	remove(m_outfile.c_str());
+	kb_set_binmap(!m_text);
+	kb_set_zstdmap(m_zstd);
+	kb_write_dnodemap_other(m_outfile, m_dnmap);
+
+	// The substring index is only as good as the graph it was made from,
+	// so an old one must not outlive a graph that could not be written.
+	remove(kb_get_subindex_name(m_outfile).c_str());
+
+	if (access(m_outfile.c_str(), F_OK))
+		return 1;
+
+	return kb_write_subindex(kb_get_subindex_name(m_outfile),
+				 m_outfile, m_dnmap) ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+#ifndef KABIMERGE_H
+#define KABIMERGE_H
+
+/* kabimerge.h - class to merge the graph files created by kabi-parser
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * kabi-parser leaves one graph file next to each object file, and common
+ * types appear in thousands of them. This utility folds every graph file
+ * in the file list into one kernel-wide graph that kabi-lookup can search
+ * with a single load.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <string>
+#include "kabi-map.h"
+
+class kabimerge
+{
+public:
+	kabimerge(){}
+	kabimerge(int argc, char **argv);
+	int run();
+	static std::string get_helptext();
+
+private:
+	int process_args(int argc, char **argv);
+
+	dnodemap m_dnmap;		// kernel-wide graph
+	dnodemap m_filemap;		// graph of the current data file
+	std::string m_filelist = "redhat/kabi/kabi-datafiles.list";
+	std::string m_outfile = "redhat/kabi/kabi-data.kbg";
+	std::string m_userdir;
+	bool m_text = false;
+	bool m_zstd = false;
+	bool m_quiet = false;
+};
+
+#endif // KABIMERGE_H
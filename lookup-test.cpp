@@ -0,0 +1,138 @@
+/* lookup-test.cpp - writes the graphs searched by lookup-test.sh
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * lookup-test <graph> <index>
+ *
+ * Writes the graph of drivers/f<index>.c, a file that exports priv_func()
+ * and priv_next(). Both take a struct foo_priv, so the struct is seen more
+ * than once in each file, and the same struct is seen in every file. The
+ * struct has an extra member in the odd files, as a struct of the same name
+ * can have when it is defined differently by different files.
+ *
+ * The graphs are built with the kb_* calls that kabi-parser makes, so what
+ * is written is what kabi-parser would write for such a file.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <map>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "kabi-map.h"
+
+using namespace std;
+
+struct member {
+	string type;
+	string name;
+	enum ctlflags flags;
+	vector<member> members;
+};
+
+static void add_member(struct sparm *parent, const member& mb,
+		       enum ctlflags flags)
+{
+	struct sparm *sp = kb_new_sparm(parent, flags);
+	string decl = mb.type;
+	size_t pos = 0;
+	size_t end;
+
+	while ((end = decl.find(' ', pos)) != string::npos) {
+		kb_add_to_decl(sp, (char *)decl.substr(pos, end - pos).c_str());
+		pos = end + 1;
+	}
+	kb_add_to_decl(sp, (char *)decl.substr(pos).c_str());
+
+	sp->flags = (enum ctlflags)(sp->flags | mb.flags);
+	sp->name = mb.name.c_str();
+
+	if (!(mb.flags & CTL_STRUCT))
+		sp->decl = kb_cstrcat(sp->decl, sp->name);
+	else if (!mb.members.empty())
+		sp->flags = (enum ctlflags)(sp->flags | CTL_HASLIST);
+
+	kb_init_crc(sp->decl, sp, parent);
+
+	if (parent->crc == sp->crc)
+		sp->flags = (enum ctlflags)(sp->flags | CTL_BACKPTR);
+	else if ((sp->flags & CTL_HASLIST) && kb_is_dup(sp))
+		sp->flags = (enum ctlflags)
+			((sp->flags & ~CTL_HASLIST) | CTL_ISDUP);
+
+	kb_update_nodes(sp, parent);
+
+	if ((sp->flags & CTL_HASLIST) && !(sp->flags & CTL_BACKPTR))
+		for (auto& child : mb.members)
+			add_member(sp, child, CTL_NESTED);
+}
+
+static void add_export(struct sparm *file, const char *name, const char *ret,
+		       const vector<member>& args)
+{
+	struct sparm *sp = kb_new_sparm(file, CTL_EXPORTED);
+	struct sparm *rp;
+
+	sp->name = name;
+	sp->flags = (enum ctlflags)(sp->flags | CTL_FUNCTION | CTL_HASLIST);
+	kb_add_to_decl(sp, (char *)"function");
+	kb_init_crc(sp->name, sp, file);
+	kb_update_nodes(sp, file);
+
+	rp = kb_new_sparm(sp, CTL_RETURN);
+	kb_add_to_decl(rp, (char *)ret);
+	kb_init_crc(rp->decl, rp, sp);
+	kb_update_nodes(rp, sp);
+
+	for (auto& arg : args)
+		add_member(sp, arg, CTL_ARG);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		cerr << "usage: lookup-test <graph> <index>" << endl;
+		return 1;
+	}
+
+	int index = atoi(argv[2]);
+	string file = "drivers/f" + to_string(index) + ".c";
+
+	member lh = { "struct list_head", "lh", CTL_STRUCT, {
+		{ "struct list_head", "next",
+		  (enum ctlflags)(CTL_STRUCT | CTL_POINTER), {} },
+	}};
+	member priv = { "struct foo_priv", "priv",
+			(enum ctlflags)(CTL_STRUCT | CTL_POINTER), {
+		{ "int", "id", (enum ctlflags)0, {} },
+		{ "char", "name", CTL_POINTER, {} },
+	}};
+
+	if (index & 1)
+		priv.members.push_back(lh);
+
+	struct sparm *fp = kb_new_firstsparm((char *)file.c_str());
+
+	add_export(fp, "priv_func", "int", { priv });
+	add_export(fp, "priv_next", "void",
+		   { priv, { "int", "count", (enum ctlflags)0, {} } });
+
+	kb_write_dnodemap(argv[1]);
+	return 0;
+}
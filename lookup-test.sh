@@ -0,0 +1,79 @@
+#!/bin/bash
+#
+# lookup-test.sh - checks of the output of kabi-lookup
+#
+# The graphs written by lookup-test are searched in a scratch directory.
+# What kabi-lookup prints must not depend on how many jobs search the
+# files, so each query is run with -j and compared with the serial run.
+# Nor may it depend on whether the graphs are searched one at a time or
+# merged by kabi-merge, where the odd files must still have the member
+# that only they give struct foo_priv.
+#
+
+srcdir=$(cd $(dirname $0) && pwd)
+lookup=$srcdir/kabi-lookup
+merge=$srcdir/kabi-merge
+files=7
+failed=0
+
+workdir=$(mktemp -d) || exit 1
+trap "rm -rf $workdir" EXIT
+
+mkdir -p $workdir/drivers $workdir/redhat/kabi
+
+for ((i = 0; i < files; ++i)); do
+	$srcdir/lookup-test $workdir/drivers/f$i.kbg $i || exit 1
+	echo drivers/f$i.kbg >> $workdir/redhat/kabi/kabi-datafiles.list
+done
+
+cd $workdir
+
+$merge -q > /dev/null || exit 1
+
+# What a search prints, and the count -c leaves after the progress shown
+# on stderr.
+search()
+{
+	eval $lookup "$@" 2> $workdir/progress
+	awk -F '\r' 'END { print $NF }' $workdir/progress
+}
+
+queries=(
+	"-e priv_func"
+	"-e priv -v"
+	"-e priv_next -w -v"
+	"-s 'struct foo_priv'"
+	"-s 'struct list_head' -v"
+	"-d 'struct foo_priv' -v"
+	"-d priv -v"
+	"-c 'struct list_head'"
+)
+
+for query in "${queries[@]}"; do
+	serial=$(search $query)
+
+	for jobs in 2 3 4 $files; do
+		parallel=$(search -j $jobs $query)
+
+		if [ "$serial" != "$parallel" ]; then
+			echo "FAIL: -j $jobs $query"
+			failed=1
+		fi
+	done
+
+	merged=$(search -g redhat/kabi/kabi-data.kbg $query)
+
+	if [ "$serial" != "$merged" ]; then
+		echo "FAIL: -g $query"
+		failed=1
+	fi
+done
+
+# An odd file is searched by itself in the merged graph with -m.
+if ! $lookup -g redhat/kabi/kabi-data.kbg -m f1.c -e priv_func -v 2>&1 |
+     grep -q "struct list_head lh"; then
+	echo "FAIL: -g -m f1.c -e priv_func -v"
+	failed=1
+fi
+
+exit $failed
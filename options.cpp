@@ -1,4 +1,6 @@
 #include <string>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include "kabilookup.h"
 #include "options.h"
@@ -10,14 +12,20 @@ options::options()
 	kb_flags = 0;
 	longopts[OPT_NODUPS] = "no-dups";
 	longopts[OPT_ARGS] = "args";
+	longopts[OPT_REGEX] = "regex";
+	longopts[OPT_GLOB] = "glob";
+	longopts[OPT_MAXDEPTH] = "max-depth";
 }
 
-bool options::parse_long_opt(char *argstr)
+bool options::parse_long_opt(char *argstr, char ***argv)
 {
 	unsigned i;
 
+	// Skip the second hyphen.
+	++argstr;
+
 	for (i = 0; i < OPT_COUNT; ++i)
-		if(string(++argstr) == longopts[i])
+		if(string(argstr) == longopts[i])
 			break;
 	switch (i) {
 	case OPT_NODUPS :
@@ -26,6 +34,19 @@ bool options::parse_long_opt(char *argstr)
 	case OPT_ARGS	:
 		kb_flags |= KB_ARGS;
 		break;
+	case OPT_REGEX	:
+		kb_flags |= KB_REGEX;
+		break;
+	case OPT_GLOB	:
+		kb_flags |= KB_GLOB;
+		break;
+	case OPT_MAXDEPTH :
+		if (!**argv)
+			return false;
+		maxdepth = atoi(*((*argv)++));
+		if (maxdepth < 1)
+			return false;
+		break;
 	default		:
 		return false;
 	}
@@ -40,14 +61,14 @@ int options::get_options(int *idx, char **argv,
 	int index = 0;
 	char *argstr;
 
-	for (index = 0; *argv[0] == '-'; ++index) {
+	for (index = 0; *argv && (*argv[0] == '-'); ++index) {
 		int i;
 
 		// Point to the first character of the actual option
 		argstr = &(*argv++)[1];
 
 		if (*argstr == '-')
-			if(parse_long_opt(argstr))
+			if(parse_long_opt(argstr, &argv))
 				continue;
 
 		for (i = 0; argstr[i]; ++i)
@@ -66,6 +87,10 @@ bool options::parse_opt(char opt, char ***argv,
 			string &declstr, string &datafile,
 			string& maskstr, std::string &pathstr)
 {
+	// A switch that takes an argument must have one.
+	if (strchr("bcdefgjmpsxDS", opt) && !**argv)
+		return false;
+
 	switch (opt) {
 	case 'f' : datafile = *((*argv)++);
 		   break;
@@ -93,11 +118,28 @@ bool options::parse_opt(char opt, char ***argv,
 	case 's' : kb_flags |= KB_STRUCT;
 		   declstr = *((*argv)++);
 		   break;
+	case 'x' : kb_flags |= KB_LIST;
+		   declstr = *((*argv)++);
+		   break;
 	case 'v' : kb_flags |= KB_VERBOSE;
 		   kb_flags &= ~KB_QUIET;
 		   break;
 	case 'w' : kb_flags |= KB_WHOLE_WORD;
 		   break;
+	case 'r' : kb_flags |= KB_REGEX;
+		   break;
+	case 'g' : kb_flags |= KB_GRAPH;
+		   graphfile = *((*argv)++);
+		   break;
+	case 'b' : kb_flags |= KB_BATCH;
+		   batchfile = *((*argv)++);
+		   break;
+	case 'D' : kb_flags |= KB_SERVER;
+		   socket = *((*argv)++);
+		   break;
+	case 'S' : kb_flags |= KB_CLIENT;
+		   socket = *((*argv)++);
+		   break;
 	case 'h' : cout << lookup::get_version();
 		   cout << lookup::get_helptext();
 		   exit(0);
@@ -105,6 +147,10 @@ bool options::parse_opt(char opt, char ***argv,
 		   exit(0);
 	case '1' : kb_flags |= KB_JUSTONE;
 		   break;
+	case 'j' : jobs = atoi(*((*argv)++));
+		   if (jobs < 1)
+			   return false;
+		   break;
 	default  : return false;
 	}
 	return true;
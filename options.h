@@ -4,6 +4,9 @@
 enum longopt {
 	OPT_NODUPS,
 	OPT_ARGS,
+	OPT_REGEX,
+	OPT_GLOB,
+	OPT_MAXDEPTH,
 	OPT_COUNT
 };
 
@@ -22,6 +25,13 @@ enum kbflags {
 	KB_WHITE_LIST	= 1 << 11,
 	KB_VERSION	= 1 << 12,
 	KB_JUSTONE	= 1 << 13,
+	KB_GRAPH	= 1 << 14,
+	KB_SERVER	= 1 << 15,
+	KB_CLIENT	= 1 << 16,
+	KB_BATCH	= 1 << 17,
+	KB_REGEX	= 1 << 18,
+	KB_GLOB		= 1 << 19,
+	KB_LIST		= 1 << 20,
 };
 
 enum quietlvl {
@@ -40,9 +50,14 @@ public:
 	bool parse_opt(char opt, char ***argv,
 		       std::string &declstr, std::string &datafile,
 		       std::string &maskstr, std::string &pathstr);
-	bool parse_long_opt(char *argstr);
+	bool parse_long_opt(char *argstr, char ***argv);
 	void bump_qietlvl() { if (m_qlvl < QL_MAX) ++m_qlvl; }
 	int kb_flags;
+	std::string graphfile;
+	int jobs = 1;
+	int maxdepth = 0;	// levels below the symbol, 0 for all
+	std::string socket;
+	std::string batchfile;
 
 private:
 	std::string longopts[OPT_COUNT];
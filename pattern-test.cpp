@@ -0,0 +1,69 @@
+/* pattern-test.cpp - checks of the pattern class of kabi-lookup
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * Each case is matched with the pattern class, and the result must be the
+ * same as std::regex gives without the literal that is taken from the
+ * pattern. A literal that is not in every match would reject strings that
+ * match, so these are the cases where taking the literal went wrong before.
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <iostream>
+#include "pattern.h"
+
+using namespace std;
+
+struct patcase {
+	const char *pat;
+	patkind kind;
+	const char *str;
+	bool match;
+};
+
+static const patcase cases[] = {
+	// An escaped ] does not end the bracket, so "bcd" is in it.
+	{ "x[a\\]bcd]",	PAT_REGEX, "xa",		true  },
+	{ "x[a\\]bcd]",	PAT_REGEX, "x]",		true  },
+	{ "x[a\\]bcd]",	PAT_REGEX, "xe",		false },
+	{ "^dma_.*_attrs$", PAT_REGEX, "dma_map_attrs",	true  },
+	{ "^dma_.*_attrs$", PAT_REGEX, "xdma_map_attrs", false },
+
+	// A ] right after [! is in the bracket, and ! negates it.
+	{ "foo[!]x]bar", PAT_GLOB, "fooybar",		true  },
+	{ "foo[!]x]bar", PAT_GLOB, "foo]bar",		false },
+	{ "foo[!]x]bar", PAT_GLOB, "fooxbar",		false },
+	{ "*_attrs",	PAT_GLOB,  "dma_map_attrs",	true  },
+};
+
+int main()
+{
+	int failed = 0;
+
+	for (auto& pc : cases) {
+		pattern pat;
+
+		if (!pat.compile(pc.pat, pc.kind) ||
+		    (pat.match(pc.str) != pc.match)) {
+			cout << "FAIL: " << pc.pat << " " << pc.str << endl;
+			++failed;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
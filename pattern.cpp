@@ -0,0 +1,285 @@
+/* pattern.cpp - compiled search patterns for kabi-lookup
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include <cstring>
+#include "pattern.h"
+
+using namespace std;
+
+/*****************************************************************************
+ * skip_bracket(string& str, size_t pos, char neg)
+ *
+ * Returns the position after the bracket expression that starts at pos, or
+ * npos if it is not closed. neg is the character that negates the bracket,
+ * ^ for a regex or ! for a glob. A ] right after the [ or the negation is a
+ * member. In a regex, a \ escapes the next character, so \] is a member too.
+ */
+static size_t skip_bracket(const string& str, size_t pos, char neg)
+{
+	size_t i = pos + 1;
+
+	if ((i < str.size()) && (str[i] == neg))
+		++i;
+
+	if ((i < str.size()) && (str[i] == ']'))
+		++i;
+
+	for (; i < str.size(); ++i) {
+		if ((str[i] == '\\') && neg == '^')
+			++i;
+		else if (str[i] == ']')
+			return i + 1;
+	}
+
+	return string::npos;
+}
+
+/*****************************************************************************
+ * pattern::compile(string& str, patkind kind)
+ *
+ * Returns false if str is not a valid pattern of the kind.
+ */
+bool pattern::compile(const string& str, patkind kind)
+{
+	m_kind = kind;
+	m_literal.clear();
+	m_anchored = false;
+
+	try {
+		switch (kind) {
+		case PAT_PLAIN : m_literal = str;
+				 break;
+		case PAT_REGEX : m_regex.assign(str, regex::optimize);
+				 set_regex_literal(str);
+				 break;
+		case PAT_GLOB  : m_regex.assign(get_glob_regex(str),
+						regex::optimize);
+				 set_glob_literal(str);
+				 break;
+		}
+	} catch (const regex_error&) {
+		return false;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ * pattern::match(char *str)
+ */
+bool pattern::match(const char *str) const
+{
+	if (m_anchored) {
+		if (strncmp(str, m_literal.c_str(), m_literal.size()))
+			return false;
+	} else if (!strstr(str, m_literal.c_str())) {
+		return false;
+	}
+
+	return (m_kind == PAT_PLAIN) || regex_search(str, m_regex);
+}
+
+/*****************************************************************************
+ * pattern::set_regex_literal(string& re)
+ *
+ * Find the longest run of literal characters that every match of the regex
+ * must contain. Anything that is not plainly a literal ends a run, and a
+ * character that is made optional or repeated by a quantifier is dropped
+ * from it. Groups are skipped whole. There is no literal if there is an
+ * alternative outside of a group.
+ */
+void pattern::set_regex_literal(const string& re)
+{
+	string run;
+	bool runlead = (!re.empty() && (re[0] == '^'));
+	size_t i = runlead ? 1 : 0;
+
+	auto end_run = [&]() {
+		if (run.size() > m_literal.size()) {
+			m_literal = run;
+			m_anchored = runlead;
+		}
+		run.clear();
+		runlead = false;
+	};
+
+	for (size_t j = 0, depth = 0; j < re.size(); ++j) {
+		if (re[j] == '\\')
+			++j;
+		else if (re[j] == '[')
+			j = skip_bracket(re, j, '^') - 1;
+		else if (re[j] == '(')
+			++depth;
+		else if ((re[j] == ')') && depth)
+			--depth;
+		else if ((re[j] == '|') && !depth)
+			return;
+	}
+
+	while (i < re.size()) {
+		char c = re[i];
+
+		if (c == '\\') {
+			// Only an escaped punctuation mark stands for itself.
+			if ((i + 1 < re.size()) && ispunct(re[i + 1])) {
+				run += re[i + 1];
+			} else {
+				end_run();
+			}
+			i += 2;
+
+		} else if (c == '[') {
+			end_run();
+			i = skip_bracket(re, i, '^');
+
+		} else if (c == '(') {
+			int depth = 0;
+
+			end_run();
+
+			for (; i < re.size(); ++i) {
+				if (re[i] == '\\') {
+					++i;
+				} else if (re[i] == '[') {
+					i = skip_bracket(re, i, '^') - 1;
+				} else if (re[i] == '(') {
+					++depth;
+				} else if ((re[i] == ')') && !--depth) {
+					++i;
+					break;
+				}
+			}
+
+		} else if (strchr("*?{", c)) {
+			if (!run.empty())
+				run.pop_back();
+			end_run();
+
+			if (c == '{') {
+				i = re.find('}', i);
+
+				if (i == string::npos)
+					break;
+			}
+
+			++i;
+
+		} else if (strchr(".^$+)]}", c)) {
+			end_run();
+			++i;
+
+		} else {
+			run += c;
+			++i;
+		}
+	}
+
+	end_run();
+}
+
+/*****************************************************************************
+ * pattern::set_glob_literal(string& glob)
+ *
+ * Find the longest run of characters between the wildcards of the glob.
+ * Unless the glob starts with a wildcard, the first run starts the match.
+ */
+void pattern::set_glob_literal(const string& glob)
+{
+	string run;
+	bool runlead = true;
+
+	auto end_run = [&]() {
+		if (run.size() > m_literal.size()) {
+			m_literal = run;
+			m_anchored = runlead;
+		}
+		run.clear();
+		runlead = false;
+	};
+
+	for (size_t i = 0; i < glob.size(); ++i) {
+		char c = glob[i];
+		size_t end;
+
+		if ((c == '\\') && (i + 1 < glob.size())) {
+			run += glob[++i];
+		} else if ((c == '*') || (c == '?')) {
+			end_run();
+		} else if ((c == '[') &&
+			   ((end = skip_bracket(glob, i, '!')) != string::npos)) {
+			end_run();
+			i = end - 1;
+		} else {
+			run += c;
+		}
+	}
+
+	end_run();
+}
+
+/*****************************************************************************
+ * pattern::get_glob_regex(string& glob)
+ *
+ * Returns the regex that matches the same whole strings as the glob.
+ */
+string pattern::get_glob_regex(const string& glob)
+{
+	string re = "^";
+
+	for (size_t i = 0; i < glob.size(); ++i) {
+		char c = glob[i];
+		size_t end;
+
+		if ((c == '\\') && (i + 1 < glob.size()))
+			c = glob[++i];
+		else if (c == '*') {
+			re += ".*";
+			continue;
+		} else if (c == '?') {
+			re += ".";
+			continue;
+		} else if ((c == '[') &&
+			   ((end = skip_bracket(glob, i, '!')) != string::npos)) {
+			re += '[';
+
+			if (glob[++i] == '!') {
+				re += '^';
+				++i;
+			}
+
+			for (; i < end - 1; ++i) {
+				if (strchr("\\[]", glob[i]))
+					re += '\\';
+				re += glob[i];
+			}
+
+			re += ']';
+			i = end - 1;
+			continue;
+		}
+
+		if (strchr("^$\\.*+?()[]{}|", c))
+			re += '\\';
+		re += c;
+	}
+
+	return re + "$";
+}
@@ -0,0 +1,67 @@
+/* pattern.h - compiled search patterns for kabi-lookup
+ *
+ * Copyright (C) 2015  Red Hat Inc.
+ * Tony Camuso <tcamuso@redhat.com>
+ *
+ * This is free software. You can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <string>
+#include <regex>
+
+enum patkind {
+	PAT_PLAIN,	// substring
+	PAT_REGEX,	// ECMAScript regular expression, kabi-lookup -r
+	PAT_GLOB,	// shell wildcards, kabi-lookup --glob
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// pattern is the search string of kabi-lookup, compiled once and matched
+// against every declaration or name in the graph.
+//
+// Every match of a regex or glob must contain a literal string that can
+// be taken from the pattern, like "_attrs" in "^dma_.*_attrs$". A string
+// without the literal is rejected with strstr(), which is vectorized in
+// glibc, before it gets to the much slower regex matcher. A plain search
+// is just the literal.
+//
+class pattern
+{
+public:
+	pattern(){}
+
+	bool compile(const std::string& str, patkind kind);
+	bool match(const char *str) const;
+	bool match(const std::string& str) const { return match(str.c_str()); }
+	const std::string& literal() const { return m_literal; }
+	bool anchored() const { return m_anchored; }
+
+private:
+	void set_regex_literal(const std::string& re);
+	void set_glob_literal(const std::string& glob);
+	std::string get_glob_regex(const std::string& glob);
+
+	patkind m_kind = PAT_PLAIN;
+	std::string m_literal;		// must be in every match
+	bool m_anchored = false;	// m_literal must start the match
+	std::regex m_regex;
+};
+
+#endif // PATTERN_H
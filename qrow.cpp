@@ -53,6 +53,6 @@ void qrow::clear()
 	this->level = 0;
 	this->flags = 0;
 	this->file = "";
-	this->decl = "";
-	this->name = "";
+	this->decl = 0;
+	this->name = 0;
 }
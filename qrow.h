@@ -21,6 +21,7 @@
  *
  */
 #include <string>
+#include <stdint.h>
 
 class qrow {
 public:
@@ -36,7 +37,7 @@ public:
 	int level;
 	int flags;
 	std::string file;
-	std::string decl;
-	std::string name;
+	uint32_t decl;		// strtab ids, resolved when the row is printed
+	uint32_t name;
 };
 #endif // QROW_H
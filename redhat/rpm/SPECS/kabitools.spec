@@ -46,6 +46,8 @@ Source0:	{_topdir}/%{name}-%{version}.tar.gz
 BuildRequires:	gcc >= 4.8
 BuildRequires:	gcc-c++
 BuildRequires:	boost
+BuildRequires:	boost-devel
+BuildRequires:	libzstd-devel
 Requires:       boost
 Requires:	gcc >= 4.8
 
@@ -68,6 +70,10 @@ kabi-lookup 	- given the symbol name of an exported symbol, determines
 makei.sh 	- preprocesses kernel c files containing exported symbols
 kabi-data.sh	- converts the preprocessed .i files into .kb_dat graphs
 kabi-dump 	- utility for examining the contents of a kb_dat graph.
+kabi-merge	- merges all the graph files into one kernel-wide graph.
+kabi-index	- indexes the graph files for whole word lookups.
+kabi-convert	- converts the graph files to another format.
+kabi-build	- parses all the .i files of a kernel tree in parallel.
 
 kabitools-rhel-kernel-make.patch
 kabitools-fedora-kernel-make.patch
@@ -90,6 +96,10 @@ mkdir -p $RPM_BUILD_ROOT%{_sbindir}
 mkdir -p $RPM_BUILD_ROOT%{_datadir}
 cp %{_topdir}/BUILD/%{name}/kabi-parser   $RPM_BUILD_ROOT%{_sbindir}
 cp %{_topdir}/BUILD/%{name}/kabi-dump     $RPM_BUILD_ROOT%{_sbindir}
+cp %{_topdir}/BUILD/%{name}/kabi-merge    $RPM_BUILD_ROOT%{_sbindir}
+cp %{_topdir}/BUILD/%{name}/kabi-index    $RPM_BUILD_ROOT%{_sbindir}
+cp %{_topdir}/BUILD/%{name}/kabi-convert  $RPM_BUILD_ROOT%{_sbindir}
+cp %{_topdir}/BUILD/%{name}/kabi-build    $RPM_BUILD_ROOT%{_sbindir}
 cp %{_topdir}/BUILD/%{name}/kabi-lookup   $RPM_BUILD_ROOT%{_sbindir}
 cp %{_topdir}/BUILD/%{name}/kabi-graph    $RPM_BUILD_ROOT%{_sbindir}
 cp %{_topdir}/BUILD/%{name}/kabiscan      $RPM_BUILD_ROOT%{_sbindir}
@@ -103,6 +113,10 @@ cp %{_topdir}/BUILD/%{name}/kabitools-rhel8-kernel-make.patch $RPM_BUILD_ROOT%{_
 %defattr(-,root,root)
 %{_sbindir}/kabi-parser
 %{_sbindir}/kabi-dump
+%{_sbindir}/kabi-merge
+%{_sbindir}/kabi-index
+%{_sbindir}/kabi-convert
+%{_sbindir}/kabi-build
 %{_sbindir}/kabi-lookup
 %{_sbindir}/kabi-graph
 %{_sbindir}/kabiscan
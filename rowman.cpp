@@ -77,7 +77,8 @@ string &rowman::indent(int padsize)
 
 string rowman::get_name(qrow &row)
 {
-	return row.flags & CTL_POINTER ? "*" + row.name : row.name;
+	return row.flags & CTL_POINTER ? "*" + kb_str(row.name)
+				       : kb_str(row.name);
 }
 
 #include <stdio.h>
@@ -90,12 +91,12 @@ void rowman::print_row(qrow& r, bool quiet)
 	case LVL_FILE:
 		clear_dups();
 		if (set_dup(r))
-			cout << endl << "FILE: " << r.decl << endl;
+			cout << endl << "FILE: " << kb_str(r.decl) << endl;
 		break;
 	case LVL_EXPORTED:
 		clear_dups(r);
 		if (set_dup(r))
-			cout << " EXPORTED: " << r.decl << " "
+			cout << " EXPORTED: " << kb_str(r.decl) << " "
 			     << get_name(r) << endl;
 		m_isexpstruct = (r.flags & CTL_EXPSTRUCT) ? true : false;
 
@@ -110,7 +111,7 @@ void rowman::print_row(qrow& r, bool quiet)
 			else
 				cout << "  ";
 
-			cout << r.decl << " " << get_name(r) << endl;
+			cout << kb_str(r.decl) << " " << get_name(r) << endl;
 		}
 		break;
 	default:
@@ -119,7 +120,7 @@ void rowman::print_row(qrow& r, bool quiet)
 			return;
 
 		if (set_dup(r) && !quiet)
-			cout << indent(r.level) << r.decl << " "
+			cout << indent(r.level) << kb_str(r.decl) << " "
 			     << get_name(r) << endl;
 		break;
 	}
@@ -141,7 +142,7 @@ void rowman::print_row_normalized(qrow& r, bool quiet)
 		return;
 
 	if (set_dup(r)) {
-		cout << indent(current_level) << r.decl;
+		cout << indent(current_level) << kb_str(r.decl);
 		if ((current_level) > 0)
 			cout << " " << get_name(r);
 		cout << endl;
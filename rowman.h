@@ -43,12 +43,15 @@ public:
 	void put_rows_from_front_normalized(bool quiet = false);
 	void print_row(qrow& r, bool quiet = false);
 
+	// Forget the rows printed so far, as for a new data file.
+	void reset() { rows.clear(); clear_dups(); m_isexpstruct = false; }
+
 private:
 	std::string &indent(int padsize);
 	void print_row_normalized(qrow& r, bool quiet = false);
 	bool set_dup(qrow& row);
 	bool is_dup(qrow& row);
-	void clear_dups() { dups.clear(); dups.resize(LVL_COUNT); }
+	void clear_dups() { for (auto& dup : dups) dup.clear(); }
 	void clear_dups(qrow& row);
 	std::string get_name(qrow& row);
 